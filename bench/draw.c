@@ -0,0 +1,206 @@
+// Replays a corpus of status lines through the drawing pipeline without a
+// compositor and reports where the time goes.
+#include <fcft/fcft.h>
+#include <inttypes.h>
+#include <pixman.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <wayland-client.h>
+
+#include "draw.h"
+#include "log.h"
+#include "render.h"
+#include "text-cache.h"
+#include "wb.h"
+
+#define ROUNDS 20
+#define HEIGHT 20
+
+static const char *default_fonts[] = {"monospace:size=10", "sans:size=12"};
+static const uint32_t widths[] = {1366, 1920, 2560};
+static const uint32_t scales[] = {SCALE_BASE, SCALE_BASE * 3 / 2,
+                                  SCALE_BASE * 2};
+
+// Allocations are counted by interposing the allocator, which also catches
+// allocations made inside of fcft and pixman.
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+static uint64_t allocations;
+
+void *malloc(size_t size) {
+    allocations++;
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size) {
+    allocations++;
+    return __libc_calloc(n, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+    allocations++;
+    return __libc_realloc(ptr, size);
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// 64-bit FNV-1a over the visible pixels
+static uint64_t checksum(uint64_t h, pixman_image_t *pix) {
+    const unsigned char *data = (unsigned char *)pixman_image_get_data(pix);
+    int stride = pixman_image_get_stride(pix);
+    int width = pixman_image_get_width(pix);
+    for (int y = 0; y < pixman_image_get_height(pix); ++y) {
+        const unsigned char *row = data + y * stride;
+        for (int x = 0; x < width * 4; ++x) {
+            h ^= row[x];
+            h *= 0x100000001b3;
+        }
+    }
+    return h;
+}
+
+static char **read_corpus(const char *path, size_t *count) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        perror(path);
+        exit(EXIT_FAILURE);
+    }
+
+    char **lines = NULL;
+    *count = 0;
+    char *line = NULL;
+    size_t size = 0;
+    ssize_t len;
+    while ((len = getline(&line, &size, f)) != -1) {
+        line[strcspn(line, "\n")] = '\0';
+        lines = realloc(lines, (*count + 1) * sizeof(*lines));
+        lines[(*count)++] = strdup(line);
+    }
+    free(line);
+    fclose(f);
+    return lines;
+}
+
+static void bench(const char *font, uint32_t width, uint32_t scale,
+                  char **corpus, size_t n_lines) {
+    struct wb wb = {
+        .config =
+            {
+                .max_status = 4096,
+                .text_cache = 64,
+                .fg_color = 0xFFBBBBBB,
+                .bg_color = 0xFF0C0C0C,
+            },
+    };
+    snprintf(wb.config.fonts[0], sizeof(wb.config.fonts[0]), "%s", font);
+    wb.config.n_fonts = 1;
+    wl_list_init(&wb.fonts);
+    draw_workers_init(&wb, 1);
+    struct wb_bar bar = {.wb = &wb};
+    bar.status = calloc(1, wb.config.max_status + 1);
+    bar.text = malloc(wb.config.max_status);
+    load_font(&wb, scale);
+
+    struct render_ctx ctx = {
+        .width = (width * scale + SCALE_BASE / 2) / SCALE_BASE,
+        .height = (HEIGHT * scale + SCALE_BASE / 2) / SCALE_BASE,
+        .scale = scale,
+    };
+    ctx.pix = pixman_image_create_bits(PIXMAN_a8r8g8b8, ctx.width, ctx.height,
+                                       NULL, 0);
+    struct render_layout current = {0};
+
+    uint64_t parse_ns = 0, shape_ns = 0, composite_ns = 0;
+    uint64_t allocs = 0, sum = 0xcbf29ce484222325;
+    size_t frames = 0;
+    for (int round = 0; round < ROUNDS; ++round) {
+        for (size_t i = 0; i < n_lines; ++i, ++frames) {
+            uint64_t start_allocs = allocations;
+            uint64_t t0 = now_ns();
+
+            set_status(&bar, corpus[i], strlen(corpus[i]));
+            uint64_t t1 = now_ns();
+
+            struct render_layout layout = {
+                .valid = true, .width = ctx.width, .height = ctx.height};
+            layout_bar(&bar, &ctx, &layout);
+            uint64_t t2 = now_ns();
+
+            render_repaint(&ctx, &current, &layout, NULL, draw_bar, &bar);
+            uint64_t t3 = now_ns();
+
+            allocs += allocations - start_allocs;
+            parse_ns += t1 - t0;
+            shape_ns += t2 - t1;
+            composite_ns += t3 - t2;
+
+            // only the first round is checksummed, later rounds draw the
+            // same frames
+            if (round == 0) {
+                sum = checksum(sum, ctx.pix);
+            }
+        }
+    }
+
+    printf("%-20s %5u %4.2f %8.0f %8.0f %10.0f %8.0f %7.2f  %016" PRIx64 "\n",
+           font, width, (double)scale / SCALE_BASE, (double)parse_ns / frames,
+           (double)shape_ns / frames, (double)composite_ns / frames,
+           (double)(parse_ns + shape_ns + composite_ns) / frames,
+           (double)allocs / frames, sum);
+
+    pixman_image_unref(ctx.pix);
+    struct scaled_font *sf, *tmp;
+    wl_list_for_each_safe(sf, tmp, &wb.fonts, link) {
+        unload_font(&wb, sf);
+    }
+    draw_workers_finish(&wb);
+    free(bar.status);
+    free(bar.text);
+    log_flush();
+}
+
+int main(int argc, char *argv[]) {
+    const char *corpus_path = argc > 1 ? argv[1] : "bench/corpus.txt";
+    const char **fonts = default_fonts;
+    size_t n_fonts = sizeof(default_fonts) / sizeof(default_fonts[0]);
+    if (argc > 2) {
+        fonts = (const char **)&argv[2];
+        n_fonts = argc - 2;
+    }
+
+    size_t n_lines;
+    char **corpus = read_corpus(corpus_path, &n_lines);
+    if (n_lines == 0) {
+        fprintf(stderr, "%s: empty corpus\n", corpus_path);
+        return EXIT_FAILURE;
+    }
+
+    fcft_init(FCFT_LOG_COLORIZE_AUTO, false, FCFT_LOG_CLASS_ERROR);
+
+    printf("%zu lines x %d rounds, times in ns/frame\n", n_lines, ROUNDS);
+    printf("%-20s %5s %4s %8s %8s %10s %8s %7s  %s\n", "font", "width", "x",
+           "parse", "shape", "composite", "total", "allocs", "checksum");
+    for (size_t f = 0; f < n_fonts; ++f) {
+        for (size_t w = 0; w < sizeof(widths) / sizeof(widths[0]); ++w) {
+            for (size_t s = 0; s < sizeof(scales) / sizeof(scales[0]); ++s) {
+                bench(fonts[f], widths[w], scales[s], corpus, n_lines);
+            }
+        }
+    }
+
+    fcft_fini();
+    for (size_t i = 0; i < n_lines; ++i) {
+        free(corpus[i]);
+    }
+    free(corpus);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,528 @@
+// A minimal compositor that runs wb against it and measures how long a status
+// line takes from stdin to a commit on every output. It advertises
+// wl_compositor, wl_shm, wl_output and zwlr_layer_shell_v1, copies every
+// committed buffer and releases it right away, and answers frame callbacks
+// on commit, so the numbers are wb's own.
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include <wayland-server.h>
+
+#include "wlr-layer-shell-unstable-v1-server-protocol.h"
+
+#define MAX_OUTPUTS 8
+#define DEFAULT_UPDATES 500
+#define DEFAULT_WIDTH 1920
+#define DEFAULT_HEIGHT 1080
+// how long to wait for wb to show something before giving up
+#define TIMEOUT_NS 2000000000ull
+
+struct output {
+    int32_t scale;
+    struct wl_global *global;
+    uint64_t commits;     // buffers committed to its layer surface
+    uint64_t last_commit; // time of the newest one
+    uint64_t checksum;    // of the newest one
+};
+
+struct surface {
+    struct wl_resource *resource;
+    struct wl_resource *buffer; // attached since the last commit
+    struct wl_list frames;      // wl_callback resources
+    uint64_t damage;            // pixels damaged since the last commit
+    int32_t bpp;                // bytes per pixel of the newest buffer
+    struct wl_resource *layer;  // zwlr_layer_surface_v1 or NULL
+    struct output *output;      // of the layer surface
+    uint32_t height;            // requested by the layer surface
+    bool configured;
+};
+
+struct compositor {
+    struct wl_display *display;
+    struct output outputs[MAX_OUTPUTS];
+    size_t n_outputs;
+    uint32_t width, height; // mode of every output
+    uint32_t serial;
+    bool client_gone;
+
+    // totals, an update is measured by their difference
+    uint64_t requests, events;
+    uint64_t damage_bytes, attached_bytes;
+};
+
+static struct compositor comp;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void resource_destroy(struct wl_client *client,
+                             struct wl_resource *resource) {
+    wl_resource_destroy(resource);
+}
+
+static void noop() {}
+
+/* wl_region, only needs to exist */
+static const struct wl_region_interface region_impl = {
+    .destroy = resource_destroy,
+    .add = noop,
+    .subtract = noop,
+};
+
+/* wl_surface */
+static void surface_attach(struct wl_client *client,
+                           struct wl_resource *resource,
+                           struct wl_resource *buffer, int32_t x, int32_t y) {
+    struct surface *surface = wl_resource_get_user_data(resource);
+    surface->buffer = buffer;
+}
+
+static void surface_damage(struct wl_client *client,
+                           struct wl_resource *resource, int32_t x, int32_t y,
+                           int32_t width, int32_t height) {
+    struct surface *surface = wl_resource_get_user_data(resource);
+    surface->damage += (uint64_t)width * height;
+}
+
+static void callback_unlink(struct wl_resource *resource) {
+    wl_list_remove(wl_resource_get_link(resource));
+}
+
+static void surface_frame(struct wl_client *client,
+                          struct wl_resource *resource, uint32_t id) {
+    struct surface *surface = wl_resource_get_user_data(resource);
+    struct wl_resource *callback =
+        wl_resource_create(client, &wl_callback_interface, 1, id);
+    wl_resource_set_implementation(callback, NULL, NULL, callback_unlink);
+    wl_list_insert(surface->frames.prev, wl_resource_get_link(callback));
+}
+
+static int32_t shm_bpp(struct wl_shm_buffer *shm) {
+    return wl_shm_buffer_get_format(shm) == WL_SHM_FORMAT_RGB565 ? 2 : 4;
+}
+
+// 64-bit FNV-1a over the visible pixels
+static uint64_t checksum(struct wl_shm_buffer *shm) {
+    const unsigned char *data = wl_shm_buffer_get_data(shm);
+    int32_t stride = wl_shm_buffer_get_stride(shm);
+    int32_t bpp = shm_bpp(shm);
+    int32_t width = wl_shm_buffer_get_width(shm);
+    uint64_t h = 0xcbf29ce484222325;
+    for (int32_t y = 0; y < wl_shm_buffer_get_height(shm); ++y) {
+        const unsigned char *row = data + y * stride;
+        for (int32_t x = 0; x < width * bpp; ++x) {
+            h ^= row[x];
+            h *= 0x100000001b3;
+        }
+    }
+    return h;
+}
+
+static void surface_commit(struct wl_client *client,
+                           struct wl_resource *resource) {
+    struct surface *surface = wl_resource_get_user_data(resource);
+
+    // the initial commit of a layer surface asks for a configure, the bar
+    // spans the whole output
+    if (surface->layer && !surface->configured) {
+        zwlr_layer_surface_v1_send_configure(
+            surface->layer, ++comp.serial,
+            comp.width / surface->output->scale, surface->height);
+        surface->configured = true;
+    }
+
+    if (surface->buffer) {
+        struct wl_shm_buffer *shm = wl_shm_buffer_get(surface->buffer);
+        if (shm) {
+            wl_shm_buffer_begin_access(shm);
+            uint64_t sum = checksum(shm);
+            wl_shm_buffer_end_access(shm);
+            comp.attached_bytes += (uint64_t)wl_shm_buffer_get_stride(shm) *
+                                   wl_shm_buffer_get_height(shm);
+            surface->bpp = shm_bpp(shm);
+            if (surface->output) {
+                surface->output->checksum = sum;
+            }
+        }
+        // the pixels were copied, the client may reuse the buffer
+        wl_buffer_send_release(surface->buffer);
+        surface->buffer = NULL;
+
+        if (surface->output) {
+            ++surface->output->commits;
+            surface->output->last_commit = now_ns();
+        }
+    }
+    // damage is in buffer pixels, 16 bit buffers upload half the bytes
+    comp.damage_bytes += surface->damage * surface->bpp;
+    surface->damage = 0;
+
+    struct wl_resource *callback, *tmp;
+    wl_resource_for_each_safe(callback, tmp, &surface->frames) {
+        wl_callback_send_done(callback, now_ns() / 1000000);
+        wl_resource_destroy(callback);
+    }
+}
+
+static const struct wl_surface_interface surface_impl = {
+    .destroy = resource_destroy,
+    .attach = surface_attach,
+    .damage = surface_damage,
+    .frame = surface_frame,
+    .set_opaque_region = noop,
+    .set_input_region = noop,
+    .commit = surface_commit,
+    .set_buffer_transform = noop,
+    .set_buffer_scale = noop,
+    .damage_buffer = surface_damage,
+};
+
+static void surface_destroy(struct wl_resource *resource) {
+    struct surface *surface = wl_resource_get_user_data(resource);
+    if (surface->layer) {
+        wl_resource_set_user_data(surface->layer, NULL);
+    }
+    struct wl_resource *callback, *tmp;
+    wl_resource_for_each_safe(callback, tmp, &surface->frames) {
+        wl_resource_destroy(callback);
+    }
+    free(surface);
+}
+
+/* wl_compositor */
+static void compositor_create_surface(struct wl_client *client,
+                                      struct wl_resource *resource,
+                                      uint32_t id) {
+    struct surface *surface = calloc(1, sizeof(*surface));
+    wl_list_init(&surface->frames);
+    surface->resource = wl_resource_create(
+        client, &wl_surface_interface, wl_resource_get_version(resource), id);
+    wl_resource_set_implementation(surface->resource, &surface_impl, surface,
+                                   surface_destroy);
+}
+
+static void compositor_create_region(struct wl_client *client,
+                                     struct wl_resource *resource,
+                                     uint32_t id) {
+    struct wl_resource *region = wl_resource_create(
+        client, &wl_region_interface, wl_resource_get_version(resource), id);
+    wl_resource_set_implementation(region, &region_impl, NULL, NULL);
+}
+
+static const struct wl_compositor_interface compositor_impl = {
+    .create_surface = compositor_create_surface,
+    .create_region = compositor_create_region,
+};
+
+static void compositor_bind(struct wl_client *client, void *data,
+                            uint32_t version, uint32_t id) {
+    struct wl_resource *resource =
+        wl_resource_create(client, &wl_compositor_interface, version, id);
+    wl_resource_set_implementation(resource, &compositor_impl, NULL, NULL);
+}
+
+/* wl_output */
+static const struct wl_output_interface output_impl = {
+    .release = resource_destroy,
+};
+
+static void output_bind(struct wl_client *client, void *data,
+                        uint32_t version, uint32_t id) {
+    struct output *output = data;
+    struct wl_resource *resource =
+        wl_resource_create(client, &wl_output_interface, version, id);
+    wl_resource_set_implementation(resource, &output_impl, output, NULL);
+
+    wl_output_send_geometry(resource, 0, 0, 0, 0, WL_OUTPUT_SUBPIXEL_UNKNOWN,
+                            "wb", "mock", WL_OUTPUT_TRANSFORM_NORMAL);
+    wl_output_send_mode(resource, WL_OUTPUT_MODE_CURRENT, comp.width,
+                        comp.height, 60000);
+    wl_output_send_scale(resource, output->scale);
+    if (version >= WL_OUTPUT_NAME_SINCE_VERSION) {
+        char name[16];
+        snprintf(name, sizeof(name), "MOCK-%zu", output - comp.outputs);
+        wl_output_send_name(resource, name);
+    }
+    wl_output_send_done(resource);
+}
+
+/* zwlr_layer_surface_v1 */
+static void layer_surface_set_size(struct wl_client *client,
+                                   struct wl_resource *resource,
+                                   uint32_t width, uint32_t height) {
+    // NULL once the surface is gone
+    struct surface *surface = wl_resource_get_user_data(resource);
+    if (surface) {
+        surface->height = height;
+    }
+}
+
+static void layer_surface_destroy(struct wl_resource *resource) {
+    struct surface *surface = wl_resource_get_user_data(resource);
+    if (surface) {
+        surface->layer = NULL;
+        surface->output = NULL;
+    }
+}
+
+static const struct zwlr_layer_surface_v1_interface layer_surface_impl = {
+    .set_size = layer_surface_set_size,
+    .set_anchor = noop,
+    .set_exclusive_zone = noop,
+    .set_margin = noop,
+    .set_keyboard_interactivity = noop,
+    .get_popup = noop,
+    .ack_configure = noop,
+    .destroy = resource_destroy,
+    .set_layer = noop,
+    .set_exclusive_edge = noop,
+};
+
+/* zwlr_layer_shell_v1 */
+static void layer_shell_get_layer_surface(struct wl_client *client,
+                                          struct wl_resource *resource,
+                                          uint32_t id,
+                                          struct wl_resource *surface_resource,
+                                          struct wl_resource *output_resource,
+                                          uint32_t layer,
+                                          const char *namespace) {
+    struct surface *surface = wl_resource_get_user_data(surface_resource);
+    surface->output = output_resource
+                          ? wl_resource_get_user_data(output_resource)
+                          : &comp.outputs[0];
+    struct wl_resource *layer_surface =
+        wl_resource_create(client, &zwlr_layer_surface_v1_interface,
+                           wl_resource_get_version(resource), id);
+    wl_resource_set_implementation(layer_surface, &layer_surface_impl,
+                                   surface, layer_surface_destroy);
+    surface->layer = layer_surface;
+}
+
+static const struct zwlr_layer_shell_v1_interface layer_shell_impl = {
+    .get_layer_surface = layer_shell_get_layer_surface,
+    .destroy = resource_destroy,
+};
+
+static void layer_shell_bind(struct wl_client *client, void *data,
+                             uint32_t version, uint32_t id) {
+    struct wl_resource *resource = wl_resource_create(
+        client, &zwlr_layer_shell_v1_interface, version, id);
+    wl_resource_set_implementation(resource, &layer_shell_impl, NULL, NULL);
+}
+
+static void log_message(void *data, enum wl_protocol_logger_type type,
+                        const struct wl_protocol_logger_message *message) {
+    if (type == WL_PROTOCOL_LOGGER_REQUEST) {
+        ++comp.requests;
+    } else {
+        ++comp.events;
+    }
+}
+
+static void client_destroyed(struct wl_listener *listener, void *data) {
+    comp.client_gone = true;
+}
+
+static struct wl_listener client_listener = {.notify = client_destroyed};
+
+// Dispatches until every output has more commits than in before, returns
+// false on timeout or if wb is gone.
+static bool wait_commits(const uint64_t *before) {
+    struct wl_event_loop *loop = wl_display_get_event_loop(comp.display);
+    uint64_t deadline = now_ns() + TIMEOUT_NS;
+    while (!comp.client_gone) {
+        bool done = true;
+        for (size_t i = 0; i < comp.n_outputs; ++i) {
+            done &= comp.outputs[i].commits > before[i];
+        }
+        if (done) {
+            return true;
+        }
+        uint64_t now = now_ns();
+        if (now >= deadline) {
+            return false;
+        }
+        wl_display_flush_clients(comp.display);
+        wl_event_loop_dispatch(loop, (deadline - now) / 1000000 + 1);
+    }
+    return false;
+}
+
+static int compare_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [-n UPDATES] [-s SCALE]... [-w WIDTH] [WB [ARG]...]\n"
+            "Runs WB (default ./wb) against a mock compositor with one\n"
+            "output per -s (default one output at scale 1).\n",
+            prog);
+}
+
+int main(int argc, char *argv[]) {
+    size_t updates = DEFAULT_UPDATES;
+    comp.width = DEFAULT_WIDTH;
+    comp.height = DEFAULT_HEIGHT;
+    int opt;
+    while ((opt = getopt(argc, argv, "+n:s:w:h")) != -1) {
+        switch (opt) {
+        case 'n':
+            updates = strtoul(optarg, NULL, 10);
+            break;
+        case 's':
+            if (comp.n_outputs == MAX_OUTPUTS) {
+                fprintf(stderr, "at most %d outputs\n", MAX_OUTPUTS);
+                return EXIT_FAILURE;
+            }
+            comp.outputs[comp.n_outputs++].scale = atoi(optarg);
+            break;
+        case 'w':
+            comp.width = strtoul(optarg, NULL, 10);
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+    if (comp.n_outputs == 0) {
+        comp.outputs[comp.n_outputs++].scale = 1;
+    }
+    char *default_cmd[] = {"./wb", NULL};
+    char **cmd = optind < argc ? &argv[optind] : default_cmd;
+
+    comp.display = wl_display_create();
+    if (!comp.display || wl_display_init_shm(comp.display) < 0) {
+        fprintf(stderr, "failed to create the display\n");
+        return EXIT_FAILURE;
+    }
+    wl_display_add_shm_format(comp.display, WL_SHM_FORMAT_RGB565);
+    wl_global_create(comp.display, &wl_compositor_interface, 4, NULL,
+                     compositor_bind);
+    wl_global_create(comp.display, &zwlr_layer_shell_v1_interface, 4, NULL,
+                     layer_shell_bind);
+    for (size_t i = 0; i < comp.n_outputs; ++i) {
+        struct output *output = &comp.outputs[i];
+        output->global = wl_global_create(comp.display, &wl_output_interface,
+                                          4, output, output_bind);
+    }
+    wl_display_add_protocol_logger(comp.display, log_message, NULL);
+
+    // wb is connected through WAYLAND_SOCKET and reads its status from a
+    // pipe
+    int sv[2], input[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) < 0 ||
+        pipe2(input, O_CLOEXEC) < 0) {
+        perror("socketpair");
+        return EXIT_FAILURE;
+    }
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return EXIT_FAILURE;
+    } else if (pid == 0) {
+        char fd[16];
+        snprintf(fd, sizeof(fd), "%d", sv[1]);
+        setenv("WAYLAND_SOCKET", fd, 1);
+        fcntl(sv[1], F_SETFD, 0);
+        dup2(input[0], STDIN_FILENO);
+        execvp(cmd[0], cmd);
+        perror(cmd[0]);
+        _exit(EXIT_FAILURE);
+    }
+    close(sv[1]);
+    close(input[0]);
+    signal(SIGPIPE, SIG_IGN);
+
+    struct wl_client *client = wl_client_create(comp.display, sv[0]);
+    wl_client_add_destroy_listener(client, &client_listener);
+
+    // the first frame shows an empty bar
+    uint64_t before[MAX_OUTPUTS] = {0};
+    if (!wait_commits(before)) {
+        fprintf(stderr, "%s did not show up on every output\n", cmd[0]);
+        kill(pid, SIGTERM);
+        waitpid(pid, NULL, 0);
+        return EXIT_FAILURE;
+    }
+
+    uint64_t *latencies = calloc(updates, sizeof(*latencies));
+    size_t measured = 0, timeouts = 0;
+    uint64_t requests = comp.requests, events = comp.events;
+    uint64_t damage = comp.damage_bytes, attached = comp.attached_bytes;
+    for (size_t i = 0; i < updates && !comp.client_gone; ++i) {
+        // a static left part, a changing center and a clock like right part
+        char line[128];
+        int len = snprintf(line, sizeof(line),
+                           "1 2 3 4 5\x1fupdate %zu\x1f%02zu:%02zu:%02zu\n", i,
+                           i / 3600 % 24, i / 60 % 60, i % 60);
+        for (size_t j = 0; j < comp.n_outputs; ++j) {
+            before[j] = comp.outputs[j].commits;
+        }
+
+        uint64_t start = now_ns();
+        if (write(input[1], line, len) != len) {
+            break;
+        }
+        if (!wait_commits(before)) {
+            ++timeouts;
+            continue;
+        }
+        // the update is visible once the last output committed it
+        uint64_t last = 0;
+        for (size_t j = 0; j < comp.n_outputs; ++j) {
+            if (comp.outputs[j].last_commit > last) {
+                last = comp.outputs[j].last_commit;
+            }
+        }
+        latencies[measured++] = last - start;
+    }
+    requests = comp.requests - requests;
+    events = comp.events - events;
+    damage = comp.damage_bytes - damage;
+    attached = comp.attached_bytes - attached;
+
+    close(input[1]);
+    int status;
+    waitpid(pid, &status, 0);
+
+    printf("%zu updates on %zu outputs, %zu timed out\n", measured,
+           comp.n_outputs, timeouts);
+    if (measured > 0) {
+        qsort(latencies, measured, sizeof(*latencies), compare_u64);
+        printf("latency (us): p50 %.1f p99 %.1f max %.1f\n",
+               latencies[measured / 2] / 1e3,
+               latencies[(measured * 99 + 99) / 100 - 1] / 1e3,
+               latencies[measured - 1] / 1e3);
+        printf("per update: %.1f requests, %.1f events, %.0f bytes damaged, "
+               "%.0f bytes attached\n",
+               (double)requests / measured, (double)events / measured,
+               (double)damage / measured, (double)attached / measured);
+    }
+    for (size_t i = 0; i < comp.n_outputs; ++i) {
+        printf("output %zu (scale %d): %lu commits, checksum %016lx\n", i,
+               comp.outputs[i].scale, (unsigned long)comp.outputs[i].commits,
+               (unsigned long)comp.outputs[i].checksum);
+    }
+
+    free(latencies);
+    if (!comp.client_gone) {
+        wl_client_destroy(client);
+    }
+    wl_display_destroy(comp.display);
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0 && timeouts == 0
+               ? EXIT_SUCCESS
+               : EXIT_FAILURE;
+}
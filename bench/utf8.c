@@ -0,0 +1,106 @@
+// Compares utf8_decode() against the mbrtoc32 based decoder it replaced on
+// typical status lines.
+#include <locale.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <uchar.h>
+
+#include "utf8.h"
+
+#define ITERATIONS 200000
+
+static const char *corpus[] = {
+    // clock only
+    "Mon Oct 17 14:03:22 2026",
+    // typical three segment status with nerd font icons
+    " 1  2  3 \x1f Mon Oct 17 14:03:22 \x1f "
+    "\xef\x8b\x9b 12% \xef\x83\x89 4.1G \xf3\xb0\x81\xb9 87% "
+    "\xf3\xb0\x96\xa9 wlan0 ",
+    // long ascii line
+    "cpu 3% 2% 7% 1% | mem 4121M/15843M | swap 0M | load 0.31 0.44 0.52 | "
+    "disk / 41% /home 67% | net up 12.4K/s down 1.2M/s | vol 45% | "
+    "bat 87% discharging 3:12 | 2026-10-17 14:03:22",
+    // workspace names in cjk
+    "\xe4\xb8\x80 \xe4\xba\x8c \xe4\xb8\x89 \xe5\x9b\x9b \xe4\xba\x94\x1f"
+    "\xe7\xbb\x88\xe7\xab\xaf \xe2\x80\x94 vim\x1f 14:03",
+};
+
+// the decoder used before utf8_decode()
+static size_t mbsntoc32(char32_t *dst, const char *src, size_t nms,
+                        size_t len) {
+    mbstate_t ps = {0};
+    char32_t *out = dst;
+    const char *in = src;
+    size_t consumed = 0;
+    size_t chars = 0;
+    size_t rc;
+
+    while ((out == NULL || chars < len) && consumed < nms &&
+           (rc = mbrtoc32(out, in, nms - consumed, &ps)) != 0) {
+        switch (rc) {
+        case (size_t)-1:
+        case (size_t)-2:
+        case (size_t)-3:
+            return (size_t)-1;
+        }
+        in += rc;
+        consumed += rc;
+        chars++;
+        if (out != NULL)
+            out++;
+    }
+    return chars;
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+int main(void) {
+    if (!setlocale(LC_ALL, "C.UTF-8")) {
+        fprintf(stderr, "C.UTF-8 locale not available\n");
+        return EXIT_FAILURE;
+    }
+
+    printf("%-8s %10s %14s %14s %8s\n", "string", "bytes", "mbrtoc32 ns",
+           "utf8 ns", "speedup");
+
+    for (size_t c = 0; c < sizeof(corpus) / sizeof(corpus[0]); ++c) {
+        const char *str = corpus[c];
+        size_t len = strlen(str);
+        uint32_t a[len];
+        char32_t b[len];
+
+        // both decoders must agree on valid input
+        size_t na = utf8_decode(a, str, len);
+        size_t nb = mbsntoc32(b, str, len + 1, len);
+        if (na != nb || memcmp(a, b, na * sizeof(*a)) != 0) {
+            fprintf(stderr, "string %zu: decoders disagree\n", c);
+            return EXIT_FAILURE;
+        }
+
+        uint64_t start = now_ns();
+        for (int i = 0; i < ITERATIONS; ++i) {
+            mbsntoc32(b, str, len + 1, len);
+            __asm__ volatile("" : : "r"(b) : "memory");
+        }
+        double old_ns = (double)(now_ns() - start) / ITERATIONS;
+
+        start = now_ns();
+        for (int i = 0; i < ITERATIONS; ++i) {
+            utf8_decode(a, str, len);
+            __asm__ volatile("" : : "r"(a) : "memory");
+        }
+        double new_ns = (double)(now_ns() - start) / ITERATIONS;
+
+        printf("%-8zu %10zu %14.1f %14.1f %7.1fx\n", c, len, old_ns, new_ns,
+               old_ns / new_ns);
+    }
+
+    return EXIT_SUCCESS;
+}
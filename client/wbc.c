@@ -0,0 +1,121 @@
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "ipc.h"
+
+static void print_usage(const char *prog_name) {
+    printf("Usage: %s [OPTION]... NAME [VALUE]\n", prog_name);
+    // clang-format off
+    printf(
+    "Sets the value of the %%{ipc:NAME} modules of a running wb.\n"
+    "Without VALUE every line read from stdin is sent as a new value.\n"
+    "\n"
+    "Options:\n"
+    "  -s, --socket=PATH     connect to PATH instead of the default socket\n"
+    "  -h, --help            show this help message\n"
+    );
+    // clang-format on
+}
+
+static int send_all(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0) {
+            return -1;
+        }
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static int send_value(int fd, const char *name, const char *value,
+                      size_t len) {
+    if (len > IPC_MAX_VALUE) {
+        len = IPC_MAX_VALUE;
+    }
+    struct ipc_header header = {
+        .type = IPC_SET,
+        .name_len = strlen(name),
+        .value_len = len,
+    };
+
+    // one write per message so the server sees it at once
+    char frame[IPC_MAX_FRAME];
+    memcpy(frame, &header, sizeof(header));
+    memcpy(frame + sizeof(header), name, header.name_len);
+    memcpy(frame + sizeof(header) + header.name_len, value, len);
+    return send_all(fd, frame,
+                    sizeof(header) + header.name_len + header.value_len);
+}
+
+int main(int argc, char *argv[]) {
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    ipc_socket_path(addr.sun_path, sizeof(addr.sun_path));
+
+    int opt;
+    struct option long_options[] = {
+        {"help", no_argument, 0, 'h'},
+        {"socket", required_argument, 0, 's'},
+        {0},
+    };
+    while ((opt = getopt_long(argc, argv, "s:h", long_options, NULL)) != -1) {
+        switch (opt) {
+        case 's':
+            snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", optarg);
+            break;
+        case 'h':
+            print_usage(argv[0]);
+            return EXIT_SUCCESS;
+        default:
+            printf("Try %s --help for more information.\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (optind >= argc || argc - optind > 2) {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    const char *name = argv[optind];
+    size_t name_len = strlen(name);
+    if (name_len == 0 || name_len > UINT8_MAX) {
+        fprintf(stderr, "name must be between 1 and %d bytes\n", UINT8_MAX);
+        return EXIT_FAILURE;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        fprintf(stderr, "failed to connect to %s\n", addr.sun_path);
+        return EXIT_FAILURE;
+    }
+
+    int ret = 0;
+    if (optind + 1 < argc) {
+        const char *value = argv[optind + 1];
+        ret = send_value(fd, name, value, strlen(value));
+    } else {
+        char *line = NULL;
+        size_t cap = 0;
+        ssize_t len;
+        while (ret == 0 && (len = getline(&line, &cap, stdin)) > 0) {
+            if (line[len - 1] == '\n') {
+                --len;
+            }
+            ret = send_value(fd, name, line, len);
+        }
+        free(line);
+    }
+    close(fd);
+
+    if (ret < 0) {
+        fprintf(stderr, "failed to send to %s\n", addr.sun_path);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,231 @@
+#define _GNU_SOURCE
+
+#include "config.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include "log.h"
+
+// far beyond any sane bar, keeps the buffers and the exclusive zone in range
+#define MAX_HEIGHT 4096
+
+// a file being created is still empty, it is read once it is closed
+#define WATCH_FILE (IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE)
+// a missing directory of the file is waited for in the nearest parent
+#define WATCH_PARENT (IN_CREATE | IN_MOVED_TO)
+
+// the directory watched for the config, a prefix of its path
+static int watch_wd = -1;
+static size_t watch_len;
+
+char *config_default_path(void) {
+    const char *base = getenv("XDG_CONFIG_HOME");
+    const char *suffix = "/wb/config";
+    if (!base || !*base) {
+        base = getenv("HOME");
+        suffix = "/.config/wb/config";
+    }
+    if (!base || !*base) {
+        return NULL;
+    }
+    char *path = malloc(strlen(base) + strlen(suffix) + 1);
+    strcpy(path, base);
+    strcat(path, suffix);
+    return path;
+}
+
+static char *trim(char *s) {
+    while (isspace((unsigned char)*s)) {
+        ++s;
+    }
+    char *end = s + strlen(s);
+    while (end > s && isspace((unsigned char)end[-1])) {
+        --end;
+    }
+    *end = '\0';
+    return s;
+}
+
+static bool parse_uint(const char *value, int base, uint32_t *out) {
+    // strtoul would wrap a sign around
+    if (!isxdigit((unsigned char)*value)) {
+        return false;
+    }
+    char *end;
+    errno = 0;
+    unsigned long n = strtoul(value, &end, base);
+    if (*end || errno || n > UINT32_MAX) {
+        return false;
+    }
+    *out = n;
+    return true;
+}
+
+static bool parse_bool(const char *value, bool *out) {
+    if (strcmp(value, "true") == 0 || strcmp(value, "1") == 0) {
+        *out = true;
+    } else if (strcmp(value, "false") == 0 || strcmp(value, "0") == 0) {
+        *out = false;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool config_load(struct wb_config *config, const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        return false;
+    }
+
+    bool fonts = false; // set once the first font line replaced the fonts
+    char *line = NULL;
+    size_t size = 0;
+    for (int n = 1; getline(&line, &size, f) != -1; ++n) {
+        line[strcspn(line, "#\n")] = '\0';
+        char *key = trim(line);
+        if (!*key) {
+            continue;
+        }
+        char *eq = strchr(key, '=');
+        if (!eq) {
+            log_warn("%s:%d: expected key = value", path, n);
+            continue;
+        }
+        *eq = '\0';
+        char *value = trim(eq + 1);
+        key = trim(key);
+
+        bool ok = true;
+        if (strcmp(key, "font") == 0) {
+            // an empty font line leaves the fonts as they are
+            ok = *value && (!fonts || config->n_fonts < WB_MAX_FONTS);
+            if (ok && !fonts) {
+                config->n_fonts = 0;
+                fonts = true;
+            }
+            if (ok) {
+                snprintf(config->fonts[config->n_fonts],
+                         sizeof(config->fonts[0]), "%s", value);
+                ++config->n_fonts;
+            }
+        } else if (strcmp(key, "height") == 0) {
+            // a layer surface must not be 0 high unless it is stretched
+            uint32_t height;
+            ok = parse_uint(value, 10, &height) && height > 0 &&
+                 height <= MAX_HEIGHT;
+            config->bars[0].height = ok ? height : config->bars[0].height;
+        } else if (strcmp(key, "fg") == 0) {
+            ok = parse_uint(value, 16, &config->fg_color);
+        } else if (strcmp(key, "bg") == 0) {
+            ok = parse_uint(value, 16, &config->bg_color);
+        } else if (strcmp(key, "bottom") == 0) {
+            ok = parse_bool(value, &config->bars[0].bottom);
+        } else if (strcmp(key, "log-level") == 0) {
+            int level = log_level_from_name(value);
+            ok = level >= 0;
+            config->log_level = ok ? level : config->log_level;
+        } else {
+            log_warn("%s:%d: unknown key '%s'", path, n, key);
+            continue;
+        }
+        if (!ok) {
+            log_warn("%s:%d: bad value for '%s'", path, n, key);
+        }
+    }
+    free(line);
+    fclose(f);
+    return true;
+}
+
+// length of the directory part of the first len bytes of path, 0 for the
+// working directory
+static size_t dir_len(const char *path, size_t len) {
+    const char *slash = memrchr(path, '/', len);
+    return !slash ? 0 : slash == path ? 1 : slash - path;
+}
+
+// Watches the directory of path, or the nearest parent of it that exists.
+// Returns false if not even that can be watched.
+static bool watch_nearest(int fd, const char *path) {
+    size_t file_dir = dir_len(path, strlen(path));
+    size_t len = file_dir;
+    while (true) {
+        char *dir = len ? strndup(path, len) : strdup(".");
+        uint32_t mask = len == file_dir ? WATCH_FILE : WATCH_PARENT;
+        // moving a directory away leaves the watch on it, it is redone
+        int wd = inotify_add_watch(fd, dir, mask | IN_MOVE_SELF | IN_ONLYDIR);
+        int err = errno;
+        free(dir);
+        if (wd >= 0) {
+            if (watch_wd >= 0 && watch_wd != wd) {
+                inotify_rm_watch(fd, watch_wd);
+            }
+            watch_wd = wd;
+            watch_len = len;
+            return true;
+        }
+
+        size_t parent = dir_len(path, len);
+        if ((err != ENOENT && err != ENOTDIR) || parent == len) {
+            return false;
+        }
+        len = parent;
+    }
+}
+
+int config_watch(const char *path) {
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd >= 0 && !watch_nearest(fd, path)) {
+        log_warn("cannot watch %s, the config is not reloaded", path);
+        close(fd);
+        fd = -1;
+    }
+    return fd;
+}
+
+bool config_changed(int fd, const char *path) {
+    size_t file_dir = dir_len(path, strlen(path));
+    const char *name = path + file_dir + (path[file_dir] == '/');
+    // the directory below the watched one on the way to the file
+    const char *next = path + watch_len + (path[watch_len] == '/');
+    size_t next_len = strcspn(next, "/");
+    bool in_dir = watch_len == file_dir;
+
+    // events are aligned for struct inotify_event
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    bool changed = false, rewatch = false;
+    ssize_t len;
+    while ((len = read(fd, buf, sizeof(buf))) > 0) {
+        for (char *p = buf; p < buf + len;) {
+            const struct inotify_event *event = (struct inotify_event *)p;
+            p += sizeof(*event) + event->len;
+            if (event->wd != watch_wd) {
+                continue; // a watch that was replaced
+            }
+            if (event->mask & (IN_IGNORED | IN_MOVE_SELF)) {
+                rewatch = true; // the directory is gone
+            } else if (!event->len) {
+                continue;
+            } else if (in_dir) {
+                changed |= strcmp(event->name, name) == 0;
+            } else if (strlen(event->name) == next_len &&
+                       strncmp(event->name, next, next_len) == 0) {
+                rewatch = true;
+            }
+        }
+    }
+
+    if (rewatch && watch_nearest(fd, path)) {
+        // the file went away with its directory or may have come with it
+        changed |= in_dir || access(path, F_OK) == 0;
+    }
+    return changed;
+}
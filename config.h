@@ -0,0 +1,29 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <stdbool.h>
+
+#include "wb.h"
+
+// Returns $XDG_CONFIG_HOME/wb/config, or ~/.config/wb/config without it, as
+// a heap allocated string. NULL if neither variable is set.
+char *config_default_path(void);
+
+// Applies a config file on top of config. Lines are `key = value` with the
+// long option names as keys (font, height, fg, bg, bottom, log-level), `#`
+// starts a comment and font lines replace the fonts from the command line.
+// height and bottom apply to the first bar. Unknown keys and bad values are
+// skipped with a warning. Returns false if the file cannot be read.
+bool config_load(struct wb_config *config, const char *path);
+
+// Watches the directory of path, editors often replace the file rather than
+// rewriting it. While the directory does not exist its nearest existing
+// parent is watched, so a config created later is still picked up. Returns
+// a non-blocking inotify fd or -1.
+int config_watch(const char *path);
+
+// Reads the pending events of the watch, returns true if one of them
+// changed the file.
+bool config_changed(int fd, const char *path);
+
+#endif
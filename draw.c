@@ -0,0 +1,689 @@
+#include "draw.h"
+
+#include <assert.h>
+#include <fcft/fcft.h>
+#include <fontconfig/fontconfig.h>
+#include <pixman.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wayland-client.h>
+
+#include "log.h"
+#include "render.h"
+#include "stats.h"
+#include "text-cache.h"
+#include "utf8.h"
+#include "wb.h"
+
+static pixman_color_t argb_to_pixman(uint32_t argb) {
+    uint16_t a = (argb >> 24) & 0xFF;
+    uint16_t r = (argb >> 16) & 0xFF;
+    uint16_t g = (argb >> 8) & 0xFF;
+    uint16_t b = (argb >> 0) & 0xFF;
+    // premultiplies
+    pixman_color_t color = {
+        (r << 8) * a / 0xFF,
+        (g << 8) * a / 0xFF,
+        (b << 8) * a / 0xFF,
+        a << 8,
+    };
+
+    return color;
+}
+
+// Blends a color over an opaque one, for images without an alpha channel.
+static uint32_t blend_over(uint32_t argb, uint32_t under) {
+    uint32_t a = argb >> 24, blended = 0xFF000000;
+    for (int shift = 0; shift < 24; shift += 8) {
+        uint32_t c = ((argb >> shift) & 0xFF) * a +
+                     ((under >> shift) & 0xFF) * (0xFF - a);
+        blended |= (c / 0xFF) << shift;
+    }
+    return blended;
+}
+
+enum align { ALIGN_START, ALIGN_CENTER, ALIGN_END };
+
+// shapes the string, or reuses the cached run if it has been shaped before
+static const struct text_cache_entry *shape_text(struct wb_worker *w,
+                                                 struct fcft_font *font,
+                                                 const char *str, size_t len) {
+    const struct text_cache_entry *shaped =
+        text_cache_get(&w->text_cache, font, str, len);
+    if (!shaped) {
+        // utf-8 never decodes to more code points than bytes
+        if (len > w->utf32_len) {
+            w->utf32 = realloc(w->utf32, len * sizeof(*w->utf32));
+            w->utf32_len = len;
+        }
+        uint64_t start = stats_now();
+        size_t n = utf8_decode(w->utf32, str, len);
+        stats_record(STATS_DECODE, start);
+
+        // fcft fonts lock their own glyph caches and may be shared by workers
+        start = stats_now();
+        struct fcft_text_run *text_run = fcft_rasterize_text_run_utf32(
+            font, n, w->utf32, FCFT_SUBPIXEL_NONE);
+        assert(text_run);
+        stats_record(STATS_SHAPE, start);
+        shaped = text_cache_put(&w->text_cache, font, str, len, text_run);
+    }
+    return shaped;
+}
+
+// Composites a batch of consecutive non-color glyphs in one call.
+static void draw_glyphs(struct wb_worker *w, pixman_image_t *pix,
+                        pixman_image_t *clr_pix, size_t count) {
+    if (count > 0) {
+        pixman_composite_glyphs_no_mask(PIXMAN_OP_OVER, clr_pix, pix, 0, 0, 0,
+                                        0, w->glyph_cache, count, w->glyphs);
+    }
+}
+
+static void draw_text(struct wb_worker *w, const struct text *text,
+                      struct render_ctx *ctx, pixman_color_t *color) {
+    const struct fcft_text_run *run = text->run;
+    pixman_image_t *pix = ctx->pix;
+    if (w->glyphs_len < (size_t)run->count) {
+        w->glyphs = realloc(w->glyphs, run->count * sizeof(*w->glyphs));
+        w->glyphs_len = run->count;
+    }
+
+    pixman_image_t *clr_pix = pixman_image_create_solid_fill(color);
+
+    // glyphs stay in the cache at least until it is thawed
+    pixman_glyph_cache_freeze(w->glyph_cache);
+
+    size_t n = 0;
+    int32_t x = text->x - ctx->x, y = text->y - ctx->y;
+    for (int i = 0; i < run->count; ++i) {
+        const struct fcft_glyph *g = run->glyphs[i];
+        if (g->is_color_glyph) {
+            // color glyphs are the source rather than a mask, draw what was
+            // batched so far to keep the order
+            draw_glyphs(w, pix, clr_pix, n);
+            n = 0;
+            pixman_image_composite32(PIXMAN_OP_OVER, g->pix, NULL, pix, 0, 0, 0,
+                                     0, x + g->x, y - g->y, g->width,
+                                     g->height);
+        } else {
+            // fcft glyphs live as long as their font so they make a stable
+            // key, the cache is reset whenever a font is unloaded
+            const void *cached = pixman_glyph_cache_lookup(
+                w->glyph_cache, (void *)text->font, (void *)g);
+            if (!cached) {
+                cached = pixman_glyph_cache_insert(
+                    w->glyph_cache, (void *)text->font, (void *)g, -g->x,
+                    g->y, g->pix);
+            }
+            w->glyphs[n++] = (pixman_glyph_t){x, y, cached};
+        }
+        x += g->advance.x;
+    }
+    draw_glyphs(w, pix, clr_pix, n);
+
+    pixman_glyph_cache_thaw(w->glyph_cache);
+    pixman_image_unref(clr_pix);
+}
+
+struct scaled_font *font_for_scale(struct wb *wb, uint32_t scale) {
+    struct scaled_font *sf;
+    wl_list_for_each(sf, &wb->fonts, link) {
+        if (sf->scale == scale) {
+            return sf;
+        }
+    }
+    return NULL;
+}
+
+// shapes the spans of a segment and places them next to each other, returns
+// the region covering everything the segment draws
+static struct render_region layout_segment(struct wb_bar *bar,
+                                           struct wb_worker *w,
+                                           struct scaled_font *sf,
+                                           const struct segment *seg,
+                                           int32_t x, enum align horiz,
+                                           uint32_t height) {
+    struct text *texts = &w->texts[seg->spans - bar->spans];
+
+    int32_t width = 0;
+    for (size_t i = 0; i < seg->count; ++i) {
+        const struct span *span = &seg->spans[i];
+        struct fcft_font *font = sf->fonts[span->font];
+        const struct text_cache_entry *shaped =
+            shape_text(w, font, span->text, span->len);
+
+        // vertically centered
+        int32_t y = height / 2 + (font->ascent + font->descent) / 2.0 -
+                    (font->descent > 0 ? font->descent : 0);
+        texts[i] = (struct text){
+            .font = font,
+            .run = shaped->run,
+            .x = width,
+            .y = y,
+            .width = shaped->width,
+            .x1 = width + shaped->ink_x1,
+            .x2 = width + shaped->ink_x2,
+        };
+        width += shaped->width;
+    }
+
+    switch (horiz) {
+    case ALIGN_START:
+        break;
+    case ALIGN_CENTER:
+        x -= width / 2;
+        break;
+    case ALIGN_END:
+        x -= width;
+        break;
+    }
+
+    // the pixels of a segment only depend on its spans, as long as it stays
+    // at the same position
+    struct render_region region = {.box = {INT32_MAX, 0, INT32_MIN, height}};
+    uint64_t key = 0;
+    for (size_t i = 0; i < seg->count; ++i) {
+        const struct span *span = &seg->spans[i];
+        struct text *text = &texts[i];
+        text->x += x;
+        text->x1 += x;
+        text->x2 += x;
+
+        int32_t x1 = text->x1, x2 = text->x2;
+        if (span->bg != bar->wb->config.bg_color) {
+            x1 = x1 < text->x ? x1 : text->x;
+            x2 = x2 > text->x + text->width ? x2 : text->x + text->width;
+        }
+        region.box.x1 = x1 < region.box.x1 ? x1 : region.box.x1;
+        region.box.x2 = x2 > region.box.x2 ? x2 : region.box.x2;
+
+        uint32_t colors[] = {span->fg, span->bg};
+        key =
+            hash_bytes(key ^ (uintptr_t)text->font, colors, sizeof(colors));
+        key = hash_bytes(key, span->text, span->len);
+    }
+    region.key = key;
+    return region;
+}
+
+void layout_bar(void *data, struct render_ctx *ctx,
+                struct render_layout *layout) {
+    struct wb_bar *bar = data;
+    struct wb_worker *w = &bar->wb->workers[ctx->worker];
+    struct scaled_font *sf = font_for_scale(bar->wb, ctx->scale);
+    assert(sf);
+
+    for (int i = 0; i < 3; ++i) {
+        const struct segment *seg = &bar->segments[i];
+        if (seg->count == 0) {
+            continue;
+        }
+
+        enum align horiz = ALIGN_START;
+        int32_t x = 0;
+        switch (i) {
+        case 1:
+            horiz = ALIGN_CENTER;
+            x = ctx->width / 2;
+            break;
+        case 2:
+            horiz = ALIGN_END;
+            x = ctx->width;
+            break;
+        }
+
+        struct render_region region =
+            layout_segment(bar, w, sf, seg, x, horiz, ctx->height);
+        if (region.box.x1 < 0) {
+            region.box.x1 = 0;
+        }
+        if (region.box.x2 > (int32_t)ctx->width) {
+            region.box.x2 = ctx->width;
+        }
+        if (region.box.x1 < region.box.x2) {
+            layout->regions[layout->count++] = region;
+        }
+    }
+}
+
+void draw_bar(void *data, struct render_ctx *ctx) {
+    struct wb_bar *bar = data;
+    const struct wb_config *config = &bar->wb->config;
+    struct wb_worker *w = &bar->wb->workers[ctx->worker];
+
+    // without an alpha channel the bar is opaque, translucent span
+    // backgrounds show the bar instead of the windows below
+    bool opaque = PIXMAN_FORMAT_A(pixman_image_get_format(ctx->pix)) == 0;
+
+    // Fill the area being repainted with the background color
+    pixman_color_t bg = ctx->transparent ? (pixman_color_t){0}
+                                         : argb_to_pixman(config->bg_color);
+    int n_boxes;
+    pixman_box32_t *boxes = pixman_region32_rectangles(ctx->clip, &n_boxes);
+    pixman_image_fill_boxes(PIXMAN_OP_SRC, ctx->pix, &bg, n_boxes, boxes);
+
+    // draw the spans that intersect the repainted area, the image is clipped
+    // so untouched pixels are preserved
+    if (!w->glyph_cache) {
+        w->glyph_cache = pixman_glyph_cache_create();
+    }
+    for (size_t i = 0; i < bar->n_spans; ++i) {
+        const struct span *span = &bar->spans[i];
+        struct text *text = &w->texts[i];
+        if (!text->run) {
+            continue;
+        }
+
+        // the layout is in frame space, the image may only hold a part
+        int32_t x = text->x - ctx->x;
+        pixman_box32_t box = {text->x1 - ctx->x, 0, text->x2 - ctx->x,
+                              ctx->height};
+        pixman_box32_t bg_box = {x, 0, x + text->width, ctx->height};
+        bool has_bg = span->bg != config->bg_color;
+        if (has_bg) {
+            box.x1 = box.x1 < bg_box.x1 ? box.x1 : bg_box.x1;
+            box.x2 = box.x2 > bg_box.x2 ? box.x2 : bg_box.x2;
+        }
+        if (pixman_region32_contains_rectangle(ctx->clip, &box) ==
+            PIXMAN_REGION_OUT) {
+            continue;
+        }
+
+        if (has_bg) {
+            pixman_color_t bg = argb_to_pixman(
+                opaque ? blend_over(span->bg, config->bg_color)
+                       : span->bg);
+            pixman_image_fill_boxes(PIXMAN_OP_SRC, ctx->pix, &bg, 1, &bg_box);
+        }
+        pixman_color_t fg = argb_to_pixman(span->fg);
+        draw_text(w, text, ctx, &fg);
+    }
+}
+
+// Expects a pointer to a heap allocated string and will reallocate the given
+// string in order to append the formatted string
+static void strappf(char **cstr_ptr, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int attr_len = vsnprintf(NULL, 0, fmt, args);
+    va_end(args);
+
+    assert(attr_len >= 0);
+
+    // allocate space for attribute
+    *cstr_ptr = realloc(*cstr_ptr, strlen(*cstr_ptr) + attr_len + 1);
+
+    // format
+    char attr[attr_len + 1];
+    va_start(args, fmt);
+    vsnprintf(attr, sizeof(attr), fmt, args);
+    va_end(args);
+
+    // append
+    strcat(*cstr_ptr, attr);
+}
+
+// takes a fontconfig font pattern and scales the size and pixelsize
+// attributes according to the scale paramter, in units of 1/SCALE_BASE
+// * returns a heap allocated string
+static char *scale_font_pattern(const char *pattern, uint32_t scale) {
+    FcPattern *pat = FcNameParse((const FcChar8 *)pattern);
+    double pt_size = -1.0;
+    FcResult have_pt_size = FcPatternGetDouble(pat, FC_SIZE, 0, &pt_size);
+
+    double px_size = -1.0;
+    FcResult have_px_size = FcPatternGetDouble(pat, FC_PIXEL_SIZE, 0, &px_size);
+
+    FcPatternRemove(pat, FC_SIZE, 0);
+    FcPatternRemove(pat, FC_PIXEL_SIZE, 0);
+
+    char *stripped = (char *)FcNameUnparse(pat);
+    if (have_pt_size == FcResultMatch) {
+        strappf(&stripped, ":size=%.2f", pt_size * scale / SCALE_BASE);
+    }
+    if (have_px_size == FcResultMatch) {
+        strappf(&stripped, ":pixelsize=%.2f", px_size * scale / SCALE_BASE);
+    }
+
+    FcPatternDestroy(pat);
+
+    return stripped;
+}
+
+// Parses a color of the form #RRGGBB or #AARRGGBB.
+static bool parse_color(const char *str, size_t len, uint32_t *argb) {
+    if ((len != 7 && len != 9) || str[0] != '#') {
+        return false;
+    }
+    uint32_t color = 0;
+    for (size_t i = 1; i < len; ++i) {
+        char c = str[i];
+        uint32_t digit = c >= '0' && c <= '9'   ? c - '0'
+                         : c >= 'a' && c <= 'f' ? c - 'a' + 10
+                         : c >= 'A' && c <= 'F' ? c - 'A' + 10
+                                                : 16;
+        if (digit == 16) {
+            return false;
+        }
+        color = color << 4 | digit;
+    }
+    *argb = len == 7 ? 0xFF000000 | color : color;
+    return true;
+}
+
+// Applies a ^cmd(arg) at str if it is valid and returns its length, 0 if str
+// is not markup.
+static size_t parse_markup(const struct wb_config *config, const char *str,
+                           struct span *attr) {
+    if (str[0] != '^' || !str[1] || !str[2] || str[3] != '(') {
+        return 0;
+    }
+    const char *arg = str + 4;
+    size_t len = strcspn(arg, ")\x1f");
+    if (arg[len] != ')') {
+        return 0;
+    }
+
+    if (strncmp(str + 1, "fg", 2) == 0) {
+        if (len == 0) {
+            attr->fg = config->fg_color;
+        } else if (!parse_color(arg, len, &attr->fg)) {
+            return 0;
+        }
+    } else if (strncmp(str + 1, "bg", 2) == 0) {
+        if (len == 0) {
+            attr->bg = config->bg_color;
+        } else if (!parse_color(arg, len, &attr->bg)) {
+            return 0;
+        }
+    } else if (strncmp(str + 1, "fn", 2) == 0) {
+        if (len == 0) {
+            attr->font = 0;
+        } else if (len == 1 && arg[0] >= '0' &&
+                   (size_t)(arg[0] - '0') < config->n_fonts) {
+            attr->font = arg[0] - '0';
+        } else {
+            return 0;
+        }
+    } else {
+        return 0;
+    }
+    return 4 + len + 1;
+}
+
+// Ends the span that started at start, empty spans are skipped. Once the
+// spans run out the text goes on in the last span of the segment.
+static void push_span(struct wb_bar *bar, struct segment *seg,
+                      const struct span *attr, const char *start,
+                      const char *end) {
+    static bool warned;
+    if (end == start) {
+        return;
+    }
+    if (bar->n_spans == WB_MAX_SPANS) {
+        if (!warned) {
+            log_warn("more than %d spans, later markup is ignored",
+                     WB_MAX_SPANS);
+            warned = true;
+        }
+        // the text is contiguous, a segment only ends with a separator
+        if (seg->count > 0) {
+            struct span *last = &bar->spans[bar->n_spans - 1];
+            last->len = end - last->text;
+        }
+        return;
+    }
+    struct span *span = &bar->spans[bar->n_spans++];
+    *span = *attr;
+    span->text = start;
+    span->len = end - start;
+    ++seg->count;
+}
+
+void set_status(struct wb_bar *bar, const char *line, size_t len) {
+    const struct wb_config *config = &bar->wb->config;
+    if (len > config->max_status) {
+        len = config->max_status;
+        while (len > 0 && (line[len] & 0xC0) == 0x80) {
+            --len;
+        }
+    }
+    // the status may be parsed again from itself
+    memmove(bar->status, line, len);
+    bar->status[len] = '\0';
+
+    // split into spans in a single pass while copying the text without
+    // markup. The spans point into that copy rather than the status, which
+    // stays as it was so that a reload parses the same markup again. Every
+    // monitor lays out the same spans.
+    memset(bar->segments, 0, sizeof(bar->segments));
+    bar->n_spans = 0;
+    struct span attr = {
+        .fg = config->fg_color,
+        .bg = config->bg_color,
+    };
+    int i = 0;
+    struct segment *seg = &bar->segments[0];
+    seg->spans = bar->spans;
+    const char *p = bar->status;
+    char *out = bar->text, *start = out;
+    while (true) {
+        if (*p == '\0' || *p == ALIGNMENT_SEP) {
+            push_span(bar, seg, &attr, start, out);
+            if (*p == '\0' || ++i == 3) {
+                break;
+            }
+            seg = &bar->segments[i];
+            seg->spans = &bar->spans[bar->n_spans];
+            start = out;
+            ++p;
+        } else if (p[0] == '^' && p[1] == '^') {
+            // one caret is text, the span goes on
+            *out++ = '^';
+            p += 2;
+        } else if (*p == '^') {
+            struct span next = attr;
+            size_t n = parse_markup(config, p, &next);
+            if (n) {
+                push_span(bar, seg, &attr, start, out);
+                attr = next;
+                start = out;
+                p += n;
+            } else {
+                *out++ = *p++;
+            }
+        } else {
+            *out++ = *p++;
+        }
+    }
+
+    // sanity check to ensure no buffer overflow
+    assert(p <= bar->status + len && out <= bar->text + len);
+}
+
+static struct fcft_font *open_font(const char *pattern, uint32_t scale) {
+    const char *fonts[] = {scale_font_pattern(pattern, scale)};
+    struct fcft_font *font =
+        fcft_from_name(sizeof(fonts) / sizeof(fonts[0]), fonts, NULL);
+    free((char *)fonts[0]);
+    if (font) {
+        log_info("loaded font: %s (scale %.3f)", font->name,
+                 (double)scale / SCALE_BASE);
+    }
+    return font;
+}
+
+static struct scaled_font *open_fonts(struct wb *wb, uint32_t scale) {
+    struct scaled_font *sf = calloc(1, sizeof(*sf));
+    sf->scale = scale;
+
+    for (size_t i = 0; i < wb->config.n_fonts; ++i) {
+        struct fcft_font *font = open_font(wb->config.fonts[i], scale);
+        if (!font) {
+            log_fatal("failed to load font '%s'", wb->config.fonts[i]);
+        }
+        sf->fonts[sf->count++] = font;
+    }
+    return sf;
+}
+
+static void close_font(struct wb *wb, struct scaled_font *sf,
+                       struct fcft_font *font) {
+    log_info("unloaded font: %s (scale %.3f)", font->name,
+             (double)sf->scale / SCALE_BASE);
+    for (size_t i = 0; i < wb->n_workers; ++i) {
+        text_cache_drop_font(&wb->workers[i].text_cache, font);
+    }
+    fcft_destroy(font);
+}
+
+// the glyph caches are keyed on glyph pointers which may be reused once their
+// font is gone
+static void reset_glyph_caches(struct wb *wb) {
+    for (size_t i = 0; i < wb->n_workers; ++i) {
+        struct wb_worker *w = &wb->workers[i];
+        if (w->glyph_cache) {
+            pixman_glyph_cache_destroy(w->glyph_cache);
+            w->glyph_cache = NULL;
+        }
+    }
+}
+
+void load_font(struct wb *wb, uint32_t scale) {
+    struct scaled_font *sf = open_fonts(wb, scale);
+    wl_list_insert(&wb->fonts, &sf->link);
+}
+
+static void *prefetch_main(void *data) {
+    struct wb *wb = data;
+    wb->prefetched = open_fonts(wb, wb->prefetch_scale);
+    return NULL;
+}
+
+void prefetch_font(struct wb *wb, uint32_t scale) {
+    wb->prefetch_scale = scale;
+    if (pthread_create(&wb->prefetch_thread, NULL, prefetch_main, wb) != 0) {
+        // loaded on demand instead
+        log_warn("failed to start font thread");
+        return;
+    }
+    wb->prefetching = true;
+}
+
+void wait_prefetch(struct wb *wb) {
+    if (!wb->prefetching) {
+        return;
+    }
+    pthread_join(wb->prefetch_thread, NULL);
+    wb->prefetching = false;
+    wl_list_insert(&wb->fonts, &wb->prefetched->link);
+    wb->prefetched = NULL;
+    stats_trace("fonts ready");
+}
+
+void unload_font(struct wb *wb, struct scaled_font *sf) {
+    for (size_t i = 0; i < sf->count; ++i) {
+        close_font(wb, sf, sf->fonts[i]);
+    }
+    reset_glyph_caches(wb);
+    wl_list_remove(&sf->link);
+    free(sf);
+}
+
+static bool font_changed(const struct wb_config *a, const struct wb_config *b,
+                         size_t i) {
+    return i >= a->n_fonts || i >= b->n_fonts ||
+           strcmp(a->fonts[i], b->fonts[i]) != 0;
+}
+
+bool reload_fonts(struct wb *wb, const struct wb_config *old) {
+    const struct wb_config *config = &wb->config;
+    size_t n = old->n_fonts > config->n_fonts ? old->n_fonts : config->n_fonts;
+
+    // everything is opened before anything is replaced, so a font that does
+    // not load leaves all scales as they were
+    struct fcft_font *(*opened)[WB_MAX_FONTS] =
+        calloc(wl_list_length(&wb->fonts), sizeof(*opened));
+    bool ok = true;
+    size_t j = 0;
+    struct scaled_font *sf;
+    wl_list_for_each(sf, &wb->fonts, link) {
+        for (size_t i = 0; ok && i < config->n_fonts; ++i) {
+            if (!font_changed(old, config, i)) {
+                continue;
+            }
+            opened[j][i] = open_font(config->fonts[i], sf->scale);
+            if (!opened[j][i]) {
+                log_warn("failed to load font '%s', keeping the old fonts",
+                         config->fonts[i]);
+                ok = false;
+            }
+        }
+        if (!ok) {
+            break;
+        }
+        ++j;
+    }
+
+    j = 0;
+    wl_list_for_each(sf, &wb->fonts, link) {
+        for (size_t i = 0; i < n; ++i) {
+            if (!font_changed(old, config, i)) {
+                continue;
+            }
+            if (!ok) {
+                if (opened[j][i]) {
+                    close_font(wb, sf, opened[j][i]);
+                }
+                continue;
+            }
+            if (i < sf->count) {
+                close_font(wb, sf, sf->fonts[i]);
+            }
+            sf->fonts[i] = opened[j][i];
+        }
+        if (ok) {
+            sf->count = config->n_fonts;
+        }
+        ++j;
+    }
+    free(opened);
+
+    if (ok) {
+        reset_glyph_caches(wb);
+    }
+    return ok;
+}
+
+void draw_workers_init(struct wb *wb, size_t count) {
+    wb->workers = calloc(count, sizeof(*wb->workers));
+    wb->n_workers = count;
+    // the runs of every span in a layout have to stay cached until the frame
+    // is drawn
+    size_t cache = wb->config.text_cache < WB_MAX_SPANS
+                       ? WB_MAX_SPANS
+                       : wb->config.text_cache;
+    for (size_t i = 0; i < count; ++i) {
+        text_cache_init(&wb->workers[i].text_cache, cache);
+    }
+}
+
+void draw_workers_finish(struct wb *wb) {
+    for (size_t i = 0; i < wb->n_workers; ++i) {
+        struct wb_worker *w = &wb->workers[i];
+        text_cache_finish(&w->text_cache);
+        if (w->glyph_cache) {
+            pixman_glyph_cache_destroy(w->glyph_cache);
+        }
+        free(w->utf32);
+        free(w->glyphs);
+    }
+    free(wb->workers);
+    wb->workers = NULL;
+    wb->n_workers = 0;
+}
@@ -0,0 +1,50 @@
+#ifndef DRAW_H
+#define DRAW_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "render.h"
+#include "wb.h"
+
+// Copies a line into the status and splits it into segments of spans. The
+// spans point into a second buffer, the text of the bar, since collapsing ^^
+// in the status itself would turn an escaped caret into markup when the
+// status is parsed again after a config reload. Spans are delimited by
+// markup:
+//   ^fg(#RRGGBB) ^bg(#RRGGBB)  set the colors, #AARRGGBB includes alpha
+//   ^fn(N)                     selects the Nth configured font
+// an empty argument restores the default and ^^ is a literal caret.
+void set_status(struct wb_bar *bar, const char *line, size_t len);
+
+// Returns the fonts loaded for the scale or NULL.
+// Scales are in units of 1/SCALE_BASE.
+struct scaled_font *font_for_scale(struct wb *wb, uint32_t scale);
+void load_font(struct wb *wb, uint32_t scale);
+void unload_font(struct wb *wb, struct scaled_font *sf);
+
+// Reopens the fonts that differ between old and bar->config for every loaded
+// scale, the others stay as they are. If one fails to load nothing changes
+// and false is returned, wb->config is left to the caller.
+bool reload_fonts(struct wb *wb, const struct wb_config *old);
+
+// Loads the fonts for a scale on a thread of its own, so matching them with
+// fontconfig overlaps with connecting to the compositor. wait_prefetch()
+// joins it and adds them to the loaded fonts, it does nothing if no prefetch
+// is pending.
+void prefetch_font(struct wb *wb, uint32_t scale);
+void wait_prefetch(struct wb *wb);
+
+// Allocates the scratch state of count workers, call after the config is set.
+void draw_workers_init(struct wb *wb, size_t count);
+void draw_workers_finish(struct wb *wb);
+
+// Render callbacks, data is the struct wb_bar. They only depend on the render
+// context and can draw into any pixman image. Fonts and the status must not
+// change while they run.
+void layout_bar(void *data, struct render_ctx *ctx,
+                struct render_layout *layout);
+void draw_bar(void *data, struct render_ctx *ctx);
+
+#endif
@@ -0,0 +1,168 @@
+#define _GNU_SOURCE
+
+#include "ipc.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "log.h"
+#include "modules.h"
+#include "wb.h"
+
+struct ipc *ipc_create(void) {
+    struct ipc *ipc = calloc(1, sizeof(*ipc));
+
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    ipc_socket_path(addr.sun_path, sizeof(addr.sun_path));
+    snprintf(ipc->path, sizeof(ipc->path), "%s", addr.sun_path);
+
+    ipc->fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (ipc->fd < 0) {
+        log_fatal("failed to create socket");
+    }
+
+    if (bind(ipc->fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        if (errno != EADDRINUSE) {
+            log_fatal("failed to bind socket %s", ipc->path);
+        }
+        // a socket nobody listens on is left over from a crashed instance
+        int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        bool alive =
+            connect(probe, (struct sockaddr *)&addr, sizeof(addr)) == 0;
+        close(probe);
+        if (alive) {
+            log_fatal("socket %s is in use by another instance", ipc->path);
+        }
+        unlink(ipc->path);
+        if (bind(ipc->fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+            log_fatal("failed to bind socket %s", ipc->path);
+        }
+    }
+    if (listen(ipc->fd, IPC_MAX_CLIENTS) < 0) {
+        log_fatal("failed to listen on socket %s", ipc->path);
+    }
+
+    log_info("listening on %s", ipc->path);
+    return ipc;
+}
+
+void ipc_destroy(struct ipc *ipc) {
+    for (size_t i = 0; i < ipc->n_clients; ++i) {
+        close(ipc->clients[i].fd);
+    }
+    close(ipc->fd);
+    unlink(ipc->path);
+    free(ipc);
+}
+
+size_t ipc_poll_fds(struct ipc *ipc, struct pollfd *fds) {
+    // stop accepting while full, pending connections wait in the backlog
+    fds[0] = (struct pollfd){
+        .fd = ipc->n_clients < IPC_MAX_CLIENTS ? ipc->fd : -1,
+        .events = POLLIN,
+    };
+    for (size_t i = 0; i < ipc->n_clients; ++i) {
+        fds[1 + i] = (struct pollfd){.fd = ipc->clients[i].fd, .events = POLLIN};
+    }
+    return 1 + ipc->n_clients;
+}
+
+static void remove_client(struct ipc *ipc, size_t i) {
+    close(ipc->clients[i].fd);
+    // the last client has already been handled when going backwards
+    if (i != ipc->n_clients - 1) {
+        memcpy(&ipc->clients[i], &ipc->clients[ipc->n_clients - 1],
+               sizeof(ipc->clients[i]));
+    }
+    --ipc->n_clients;
+}
+
+// Applies every complete frame in the buffer of the client, returns false if
+// the client sent garbage.
+static bool handle_frames(struct ipc_client *client, struct modules **mods,
+                          size_t n_mods, bool *changed) {
+    size_t offset = 0;
+    while (client->len - offset >= sizeof(struct ipc_header)) {
+        struct ipc_header header;
+        memcpy(&header, client->buf + offset, sizeof(header));
+        if (header.type != IPC_SET || header.name_len == 0 ||
+            header.value_len > IPC_MAX_VALUE) {
+            return false;
+        }
+
+        size_t frame_len =
+            sizeof(header) + header.name_len + header.value_len;
+        if (client->len - offset < frame_len) {
+            break;
+        }
+
+        const char *name = client->buf + offset + sizeof(header);
+        char *value = client->buf + offset + sizeof(header) + header.name_len;
+        // a value must not move the other segments or end the line
+        for (size_t i = 0; i < header.value_len; ++i) {
+            if (value[i] == ALIGNMENT_SEP || value[i] == '\n') {
+                value[i] = ' ';
+            }
+        }
+        // every bar showing the name is updated
+        bool found = false;
+        for (size_t i = 0; i < n_mods; ++i) {
+            found |= modules_set(mods[i], name, header.name_len, value,
+                                 header.value_len);
+        }
+        if (found) {
+            *changed = true;
+        } else {
+            log_debug("no module for ipc name '%.*s'", header.name_len, name);
+        }
+        offset += frame_len;
+    }
+
+    memmove(client->buf, client->buf + offset, client->len - offset);
+    client->len -= offset;
+    return true;
+}
+
+bool ipc_dispatch(struct ipc *ipc, const struct pollfd *fds,
+                  struct modules **mods, size_t n_mods) {
+    bool changed = false;
+
+    for (size_t i = ipc->n_clients; i-- > 0;) {
+        if (!(fds[1 + i].revents & (POLLIN | POLLHUP | POLLERR))) {
+            continue;
+        }
+        struct ipc_client *client = &ipc->clients[i];
+        ssize_t n = read(client->fd, client->buf + client->len,
+                         sizeof(client->buf) - client->len);
+        if (n < 0 && (errno == EAGAIN || errno == EINTR)) {
+            continue;
+        }
+        if (n > 0) {
+            client->len += n;
+            if (handle_frames(client, mods, n_mods, &changed)) {
+                continue;
+            }
+            log_warn("dropping ipc client sending invalid messages");
+        }
+        remove_client(ipc, i);
+    }
+
+    if (fds[0].revents & POLLIN) {
+        int fd;
+        while (ipc->n_clients < IPC_MAX_CLIENTS &&
+               (fd = accept4(ipc->fd, NULL, NULL,
+                             SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+            struct ipc_client *client = &ipc->clients[ipc->n_clients++];
+            client->fd = fd;
+            client->len = 0;
+        }
+    }
+
+    return changed;
+}
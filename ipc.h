@@ -0,0 +1,69 @@
+#ifndef IPC_H
+#define IPC_H
+
+#include <poll.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+struct modules;
+
+// Wire format, every message is a header followed by name_len bytes of name
+// and value_len bytes of value. Integers are in host byte order since both
+// ends are on the same machine.
+enum ipc_type {
+    IPC_SET = 1, // sets the value of the %{ipc:name} modules
+};
+
+struct ipc_header {
+    uint8_t type;
+    uint8_t name_len; // at least 1
+    uint16_t value_len; // at most IPC_MAX_VALUE
+};
+
+#define IPC_MAX_VALUE 4096
+#define IPC_MAX_FRAME (sizeof(struct ipc_header) + UINT8_MAX + IPC_MAX_VALUE)
+#define IPC_MAX_CLIENTS 32
+
+// $WB_SOCKET or a socket per wayland display in $XDG_RUNTIME_DIR.
+static inline void ipc_socket_path(char *buf, size_t size) {
+    const char *path = getenv("WB_SOCKET");
+    if (path) {
+        snprintf(buf, size, "%s", path);
+        return;
+    }
+    const char *dir = getenv("XDG_RUNTIME_DIR");
+    const char *display = getenv("WAYLAND_DISPLAY");
+    snprintf(buf, size, "%s/wb-%s.sock", dir ? dir : "/tmp",
+             display ? display : "wayland-0");
+}
+
+struct ipc_client {
+    int fd;
+    size_t len; // bytes of an incomplete frame in buf
+    char buf[IPC_MAX_FRAME];
+};
+
+// A listening socket whose messages update the modules.
+struct ipc {
+    int fd;
+    char path[108];
+    struct ipc_client clients[IPC_MAX_CLIENTS];
+    size_t n_clients;
+};
+
+struct ipc *ipc_create(void);
+void ipc_destroy(struct ipc *ipc);
+
+// Fills fds with the listening socket followed by the clients and returns
+// how many were filled, at most 1 + IPC_MAX_CLIENTS.
+size_t ipc_poll_fds(struct ipc *ipc, struct pollfd *fds);
+
+// Handles the events of the fds from ipc_poll_fds and updates the modules of
+// every set in mods, returns whether any module was updated.
+bool ipc_dispatch(struct ipc *ipc, const struct pollfd *fds,
+                  struct modules **mods, size_t n_mods);
+
+#endif
@@ -0,0 +1,138 @@
+#define _GNU_SOURCE
+
+#include "line-buffer.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "log.h"
+
+#define READ_CHUNK (64 * 1024)
+// upper bound on a single drain so a producer that never pauses cannot
+// starve the rest of the event loop, poll() reports the fd ready again
+#define READ_MAX (1024 * 1024)
+
+// makes sure at least READ_CHUNK bytes are free past the end of the buffer
+static void make_room(struct line_buffer *lb) {
+    if (lb->size - lb->end >= READ_CHUNK) {
+        return;
+    }
+
+    // everything before start has been consumed or superseded, so at most
+    // the newest line and the partial line behind it are moved
+    if (lb->start > 0) {
+        memmove(lb->data, lb->data + lb->start, lb->end - lb->start);
+        lb->end -= lb->start;
+        lb->line_end -= lb->has_line ? lb->start : 0;
+        lb->start = 0;
+    }
+
+    if (lb->size - lb->end < READ_CHUNK) {
+        size_t size = lb->size ? lb->size * 2 : READ_CHUNK;
+        while (size - lb->end < READ_CHUNK) {
+            size *= 2;
+        }
+        lb->data = realloc(lb->data, size);
+        if (!lb->data) {
+            log_fatal("failed to grow input buffer to %zu bytes", size);
+        }
+        lb->size = size;
+    }
+}
+
+// finds the newest line completed by the bytes starting at from and drops
+// every line before it
+static void frame_lines(struct line_buffer *lb, size_t from) {
+    char *nl = memrchr(lb->data + from, '\n', lb->end - from);
+    if (!nl) {
+        return;
+    }
+
+    size_t line_end = nl - lb->data;
+    char *prev = memrchr(lb->data + lb->start, '\n', line_end - lb->start);
+    if (prev) {
+        lb->start = prev - lb->data + 1;
+    }
+    lb->line_end = line_end;
+    lb->has_line = true;
+}
+
+// keeps the partial line behind the newest complete line within max_line
+// bytes, the rest of it is dropped as it arrives
+static void cut_partial(struct line_buffer *lb) {
+    size_t partial = lb->has_line ? lb->line_end + 1 : lb->start;
+    if (lb->max_line && lb->end - partial > lb->max_line) {
+        lb->end = partial + lb->max_line;
+        lb->skipping = true;
+    }
+}
+
+ssize_t line_buffer_read(struct line_buffer *lb, int fd) {
+    ssize_t total = 0;
+    while (total < READ_MAX) {
+        make_room(lb);
+
+        ssize_t n = read(fd, lb->data + lb->end, lb->size - lb->end);
+        if (n == 0) {
+            lb->eof = true;
+            // a producer that exits without a final newline still shows
+            // its last line, make_room left space for the newline
+            size_t partial = lb->has_line ? lb->line_end + 1 : lb->start;
+            if (lb->end > partial) {
+                lb->data[lb->end++] = '\n';
+                frame_lines(lb, lb->end - 1);
+            }
+            lb->skipping = false;
+            break;
+        }
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            return -1;
+        }
+
+        total += n;
+        size_t from = lb->end;
+        if (lb->skipping) {
+            char *nl = memchr(lb->data + from, '\n', n);
+            if (!nl) {
+                continue;
+            }
+            // the cut line ends here
+            size_t dropped = nl - (lb->data + from);
+            memmove(lb->data + from, nl, n - dropped);
+            n -= dropped;
+            lb->skipping = false;
+        }
+        lb->end += n;
+        frame_lines(lb, from);
+        cut_partial(lb);
+    }
+
+    return total;
+}
+
+const char *line_buffer_last_line(struct line_buffer *lb, size_t *len) {
+    if (!lb->has_line) {
+        return NULL;
+    }
+
+    const char *line = lb->data + lb->start;
+    *len = lb->line_end - lb->start;
+
+    lb->start = lb->line_end + 1;
+    lb->has_line = false;
+
+    return line;
+}
+
+void line_buffer_finish(struct line_buffer *lb) {
+    free(lb->data);
+    *lb = (struct line_buffer){0};
+}
@@ -0,0 +1,37 @@
+#ifndef LINE_BUFFER_H
+#define LINE_BUFFER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+// Growable input buffer that frames newline terminated lines in place. Only
+// the newest complete line and the trailing partial line are retained.
+// Partial lines are cut to max_line bytes unless it is 0.
+struct line_buffer {
+    size_t max_line;
+
+    char *data;
+    size_t size;  // allocated bytes
+    size_t start; // first unconsumed byte
+    size_t end;   // one past the last buffered byte
+
+    bool has_line;   // a complete line starts at start
+    size_t line_end; // offset of the newline ending that line
+    bool skipping;   // dropping the rest of a partial line that was cut
+    bool eof;
+};
+
+// Reads from a non-blocking fd until it would block or reaches end of file.
+// A partial line left at end of file counts as complete. Returns the number
+// of bytes read or -1 on error.
+ssize_t line_buffer_read(struct line_buffer *lb, int fd);
+
+// Returns the newest complete line without its newline and consumes it, or
+// NULL if no line was completed since the last call. The returned pointer
+// points into the buffer and stays valid until the next read.
+const char *line_buffer_last_line(struct line_buffer *lb, size_t *len);
+
+void line_buffer_finish(struct line_buffer *lb);
+
+#endif
@@ -1,24 +1,227 @@
 #include "log.h"
 
+#include <pthread.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+#define RING_SIZE 128   // records, a power of two
+#define RECORD_SIZE 512 // longer messages are cut
+#define BATCH 32        // records per write
+#define RATE_WINDOW 1000000000ull // ns
+#define RATE_BURST 10             // messages per call site and window
 
 static const char *levels[] = {"debug", "info", "warn", "error", "fatal"};
 
 static const int colors[] = {34, 34, 33, 31, 31};
 
-void _log(int level, const char *file, int line, const char *fmt, ...) {
+// The slot of position pos is free while its seq is pos / RING_SIZE * 2 and
+// holds a message once it is one more. Producers claim positions by moving
+// head, the consumer releases slots into the next round.
+struct record {
+    uint64_t seq;
+    size_t len;
+    char text[RECORD_SIZE];
+};
+
+static struct record ring[RING_SIZE];
+static uint64_t head;    // next position to claim
+static uint64_t tail;    // next position to write out, under flush_lock
+static uint64_t dropped; // messages lost to a full ring
+static int threshold = LOG_DEFAULT_LEVEL;
+static struct log_site *suppressing; // sites that suppressed a message
+static pthread_mutex_t flush_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Returns the slot of a free position or NULL if the ring is full.
+static struct record *claim(uint64_t *pos) {
+    uint64_t p = __atomic_load_n(&head, __ATOMIC_RELAXED);
+    while (true) {
+        struct record *r = &ring[p % RING_SIZE];
+        uint64_t seq = __atomic_load_n(&r->seq, __ATOMIC_ACQUIRE);
+        uint64_t empty = p / RING_SIZE * 2;
+        if (seq == empty) {
+            // reloads p if another thread got there first
+            if (__atomic_compare_exchange_n(&head, &p, p + 1, true,
+                                            __ATOMIC_RELAXED,
+                                            __ATOMIC_RELAXED)) {
+                *pos = p;
+                return r;
+            }
+        } else if (seq < empty) {
+            return NULL; // the previous round has not been written out yet
+        } else {
+            p = __atomic_load_n(&head, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+static size_t format_prefix(char *buf, size_t size,
+                            const struct log_site *site) {
+    int len = snprintf(buf, size, "\033[1m%s:%d:\033[0m \033[1;%dm%s:\033[0m ",
+                       site->file, site->line, colors[site->level],
+                       levels[site->level]);
+    return len < 0 ? 0 : (size_t)len < size ? (size_t)len : size - 1;
+}
+
+// Formats a whole line into buf, cut to fit and always ending in a newline.
+static size_t format_line(char *buf, size_t size, const struct log_site *site,
+                          const char *fmt, va_list args) {
+    size_t cap = size - 1; // the newline
+    size_t len = format_prefix(buf, cap, site);
+    int n = vsnprintf(buf + len, cap - len, fmt, args);
+    if (n > 0) {
+        len += (size_t)n < cap - len ? (size_t)n : cap - len - 1;
+    }
+    buf[len++] = '\n';
+    return len;
+}
+
+static void vpush(const struct log_site *site, const char *fmt,
+                  va_list args) {
+    uint64_t pos;
+    struct record *r = claim(&pos);
+    if (!r) {
+        __atomic_fetch_add(&dropped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    r->len = format_line(r->text, sizeof(r->text), site, fmt, args);
+    __atomic_store_n(&r->seq, pos / RING_SIZE * 2 + 1, __ATOMIC_RELEASE);
+}
+
+__attribute__((format(printf, 2, 3))) static void
+push(const struct log_site *site, const char *fmt, ...) {
     va_list args;
     va_start(args, fmt);
+    vpush(site, fmt, args);
+    va_end(args);
+}
 
-    fprintf(stderr, "\033[1m%s:%d:\033[0m \033[1;%dm%s:\033[0m ", file, line,
-            colors[level], levels[level]);
-    vfprintf(stderr, fmt, args);
-    fputc('\n', stderr);
+// Returns whether the site may log another message in its window.
+static bool admit(struct log_site *site) {
+    uint64_t now = now_ns();
+    uint64_t start = __atomic_load_n(&site->window, __ATOMIC_RELAXED);
+    if (now - start >= RATE_WINDOW &&
+        __atomic_compare_exchange_n(&site->window, &start, now, false,
+                                    __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        __atomic_store_n(&site->count, 0, __ATOMIC_RELAXED);
+        uint32_t n =
+            __atomic_exchange_n(&site->suppressed, 0, __ATOMIC_RELAXED);
+        if (n) {
+            push(site, "%u similar messages suppressed", n);
+        }
+    }
+    if (__atomic_fetch_add(&site->count, 1, __ATOMIC_RELAXED) < RATE_BURST) {
+        return true;
+    }
 
-    va_end(args);
+    __atomic_fetch_add(&site->suppressed, 1, __ATOMIC_RELAXED);
+    // listed once, so the summary is written even if the site stays quiet
+    if (!__atomic_exchange_n(&site->listed, true, __ATOMIC_RELAXED)) {
+        site->next = __atomic_load_n(&suppressing, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&suppressing, &site->next, site,
+                                            true, __ATOMIC_RELEASE,
+                                            __ATOMIC_RELAXED)) {
+        }
+    }
+    return false;
+}
+
+void _log(struct log_site *site, const char *fmt, ...) {
+    if (site->level < __atomic_load_n(&threshold, __ATOMIC_RELAXED)) {
+        return;
+    }
 
-    if (level == LOG_FATAL)
+    va_list args;
+    va_start(args, fmt);
+    if (site->level == LOG_FATAL) {
+        // everything before it is written first
+        log_flush();
+        char line[RECORD_SIZE];
+        size_t len = format_line(line, sizeof(line), site, fmt, args);
+        (void)!write(STDERR_FILENO, line, len);
         exit(1);
+    }
+    if (admit(site)) {
+        vpush(site, fmt, args);
+    }
+    va_end(args);
+}
+
+// Writes what a site suppressed in a window that has ended, unless a new
+// message of the site summarized it already.
+static void flush_suppressed(uint64_t now) {
+    struct log_site *site = __atomic_load_n(&suppressing, __ATOMIC_ACQUIRE);
+    for (; site; site = site->next) {
+        uint64_t start = __atomic_load_n(&site->window, __ATOMIC_RELAXED);
+        if (now - start < RATE_WINDOW) {
+            continue;
+        }
+        uint32_t n =
+            __atomic_exchange_n(&site->suppressed, 0, __ATOMIC_RELAXED);
+        if (n) {
+            char line[RECORD_SIZE];
+            size_t len = format_prefix(line, sizeof(line), site);
+            len += snprintf(line + len, sizeof(line) - len,
+                            "%u similar messages suppressed\n", n);
+            (void)!write(STDERR_FILENO, line, len);
+        }
+    }
+}
+
+void log_flush(void) {
+    pthread_mutex_lock(&flush_lock);
+    while (true) {
+        struct iovec iov[BATCH];
+        int n = 0;
+        uint64_t first = tail;
+        while (n < BATCH) {
+            struct record *r = &ring[tail % RING_SIZE];
+            if (__atomic_load_n(&r->seq, __ATOMIC_ACQUIRE) !=
+                tail / RING_SIZE * 2 + 1) {
+                break;
+            }
+            iov[n++] = (struct iovec){r->text, r->len};
+            ++tail;
+        }
+        if (n == 0) {
+            break;
+        }
+
+        // a short write loses the rest of the batch rather than blocking
+        (void)!writev(STDERR_FILENO, iov, n);
+        for (uint64_t pos = first; pos != tail; ++pos) {
+            __atomic_store_n(&ring[pos % RING_SIZE].seq,
+                             pos / RING_SIZE * 2 + 2, __ATOMIC_RELEASE);
+        }
+    }
+
+    flush_suppressed(now_ns());
+    uint64_t lost = __atomic_exchange_n(&dropped, 0, __ATOMIC_RELAXED);
+    if (lost) {
+        fprintf(stderr, "%lu log messages dropped\n", (unsigned long)lost);
+    }
+    pthread_mutex_unlock(&flush_lock);
+}
+
+void log_set_level(int level) {
+    __atomic_store_n(&threshold, level, __ATOMIC_RELAXED);
+}
+
+int log_level_from_name(const char *name) {
+    for (int i = LOG_DEBUG; i < LOG_FATAL; ++i) {
+        if (strcmp(name, levels[i]) == 0) {
+            return i;
+        }
+    }
+    return -1;
 }
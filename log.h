@@ -1,14 +1,67 @@
 #ifndef LOG_H
 #define LOG_H
 
+#include <stdbool.h>
+#include <stdint.h>
+
 enum { LOG_DEBUG, LOG_INFO, LOG_WARN, LOG_ERROR, LOG_FATAL };
 
-#define log_debug(...) _log(LOG_DEBUG, __FILE__, __LINE__, __VA_ARGS__)
-#define log_info(...) _log(LOG_INFO, __FILE__, __LINE__, __VA_ARGS__)
-#define log_warn(...) _log(LOG_WARN, __FILE__, __LINE__, __VA_ARGS__)
-#define log_error(...) _log(LOG_ERROR, __FILE__, __LINE__, __VA_ARGS__)
-#define log_fatal(...) _log(LOG_FATAL, __FILE__, __LINE__, __VA_ARGS__)
+// log_debug() only exists in builds with WB_DEBUG (make DEBUG=1)
+#ifdef WB_DEBUG
+#define LOG_DEFAULT_LEVEL LOG_DEBUG
+#else
+#define LOG_DEFAULT_LEVEL LOG_INFO
+#endif
+
+// Every call site keeps its own rate limit.
+struct log_site {
+    const char *file;
+    int line;
+    int level;
+    // changed concurrently by every thread logging here
+    uint64_t window;     // start of the current rate limit window in ns
+    uint32_t count;      // messages in the window
+    uint32_t suppressed; // messages dropped since the last summary
+    bool listed;         // on the list of sites that suppressed something
+    struct log_site *next;
+};
+
+#define LOG_AT(lvl, ...)                                                       \
+    do {                                                                       \
+        static struct log_site log_site_ = {                                   \
+            .file = __FILE__, .line = __LINE__, .level = lvl};                 \
+        _log(&log_site_, __VA_ARGS__);                                         \
+    } while (0)
+
+#ifdef WB_DEBUG
+#define log_debug(...) LOG_AT(LOG_DEBUG, __VA_ARGS__)
+#else
+// compiled out, the arguments are still type checked
+#define log_debug(...)                                                         \
+    do {                                                                       \
+        if (0) {                                                               \
+            LOG_AT(LOG_DEBUG, __VA_ARGS__);                                    \
+        }                                                                      \
+    } while (0)
+#endif
+#define log_info(...) LOG_AT(LOG_INFO, __VA_ARGS__)
+#define log_warn(...) LOG_AT(LOG_WARN, __VA_ARGS__)
+#define log_error(...) LOG_AT(LOG_ERROR, __VA_ARGS__)
+#define log_fatal(...) LOG_AT(LOG_FATAL, __VA_ARGS__)
+
+// Formats the message into a ring buffer without taking a lock, any thread
+// may log. Messages below the level are discarded and a call site logs at
+// most a burst per second, the rest is counted and summarized. Fatal
+// messages are written right away and exit.
+void _log(struct log_site *site, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+
+// Writes the buffered messages to stderr in batches, called from the event
+// loop and at exit.
+void log_flush(void);
 
-void _log(int level, const char *file, int line, const char *fmt, ...);
+void log_set_level(int level);
+// Returns the level called name (debug, info, warn, error) or -1.
+int log_level_from_name(const char *name);
 
 #endif
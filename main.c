@@ -4,6 +4,9 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "config.h"
+#include "log.h"
+#include "stats.h"
 #include "wb.h"
 
 #define STR(s) #s
@@ -11,6 +14,11 @@
 
 #define DEFAULT_FONT "monospace:size=14"
 #define DEFAULT_HEIGHT 20
+#define DEFAULT_MAX_STATUS 4096
+#define DEFAULT_TEXT_CACHE 64
+#define DEFAULT_INTERVAL 1000
+#define DEFAULT_FRAME_CACHE 8
+#define DEFAULT_FRAME_CACHE_SIZE 16
 #define DEFAULT_FG 0xFFBBBBBB
 #define DEFAULT_BG 0xFF0C0C0C
 
@@ -19,27 +27,61 @@ void print_usage(const char *prog_name) {
     // clang-format off
     printf(
     "Options:\n"
-    "  -H, --height=NUM      set height to NUM pixels (default " XSTR(DEFAULT_HEIGHT) ")\n"
-    "  -f, --font=STR        set font description (default " DEFAULT_FONT ")\n"
-    "  -b, --bottom          anchor bar to bottom of display\n"
+    "  -H, --height=NUM      set height of the bar to NUM pixels (default " XSTR(DEFAULT_HEIGHT) ")\n"
+    "  -f, --font=STR        set font description (default " DEFAULT_FONT "),\n"
+    "                        repeat to add fonts for ^fn(N)\n"
+    "  -b, --bottom          anchor the bar to bottom of display\n"
+    "  -I, --input=FILE      read status lines of the bar from FILE, e.g. a FIFO\n"
+    "                        (default stdin for the first bar)\n"
+    "  -n, --next-bar        add another bar, -H, -b, -I and -m after this\n"
+    "                        apply to it (at most " XSTR(WB_MAX_BARS) ")\n"
+    "  -l, --max-length=NUM  truncate status lines to NUM bytes (default " XSTR(DEFAULT_MAX_STATUS) ")\n"
+    "  -c, --text-cache=NUM  keep NUM shaped text runs cached (default " XSTR(DEFAULT_TEXT_CACHE) ")\n"
+    "  -m, --format=STR      build the status of the bar from modules, see README\n"
+    "  -s, --socket          accept updates of %%{ipc:NAME} modules from wbc\n"
+    "  -i, --interval=NUM    update modules every NUM ms (default " XSTR(DEFAULT_INTERVAL) ")\n"
+    "  -S, --stats=NUM       dump frame timings to stderr every NUM seconds,\n"
+    "                        SIGUSR1 dumps them at any time\n"
+    "  -C, --frame-cache=NUM keep NUM rendered frames per surface (default " XSTR(DEFAULT_FRAME_CACHE) ")\n"
+    "  -M, --frame-cache-size=NUM\n"
+    "                        limit them to NUM MiB per surface (default " XSTR(DEFAULT_FRAME_CACHE_SIZE) ")\n"
+    "  -R, --rgb565          use 16 bit buffers if the background is opaque\n"
+    "  -T, --startup-trace   print the time each startup phase finished to stderr\n"
+    "  -L, --log-level=STR   log debug, info, warn or error and above\n"
+    "                        (default info, debug in DEBUG=1 builds)\n"
+    "  -j, --jobs=NUM        draw up to NUM monitors in parallel (default: CPUs, at most 4)\n"
     "  -F, --fg=NUM          set foreground color in ARGB (default " XSTR(DEFAULT_FG) ")\n"
     "  -B  --bg=NUM          set background color in ARGB (default " XSTR(DEFAULT_BG) ")\n"
+    "  -o, --config=FILE     apply FILE and reload it when it changes\n"
+    "                        (default $XDG_CONFIG_HOME/wb/config)\n"
     "  -h, --help            show this help message\n"
     );
     // clang-format on
 }
 
 int main(int argc, char *argv[]) {
+    uint64_t start = stats_now();
     setlocale(LC_ALL, "");
+    // messages are buffered until the event loop writes them
+    atexit(log_flush);
 
     // default config
     struct wb_config config = {
-        .font = DEFAULT_FONT,
-        .height = DEFAULT_HEIGHT,
+        .bars = {{.height = DEFAULT_HEIGHT}},
+        .n_bars = 1,
+        .max_status = DEFAULT_MAX_STATUS,
+        .text_cache = DEFAULT_TEXT_CACHE,
+        .interval = DEFAULT_INTERVAL,
+        .frame_cache = DEFAULT_FRAME_CACHE,
+        .frame_cache_size = DEFAULT_FRAME_CACHE_SIZE,
         .fg_color = DEFAULT_FG,
         .bg_color = DEFAULT_BG,
+        .log_level = LOG_DEFAULT_LEVEL,
     };
 
+    // options of a single bar apply to the last one
+    struct wb_bar_config *bar = &config.bars[0];
+    bool trace = false;
     int opt;
     int option_index = 0;
     struct option long_options[] = {
@@ -47,20 +89,96 @@ int main(int argc, char *argv[]) {
         {"bottom", no_argument, 0, 'b'},
         {"font", required_argument, 0, 'f'},
         {"height", required_argument, 0, 'H'},
+        {"max-length", required_argument, 0, 'l'},
+        {"text-cache", required_argument, 0, 'c'},
+        {"format", required_argument, 0, 'm'},
+        {"interval", required_argument, 0, 'i'},
+        {"socket", no_argument, 0, 's'},
+        {"stats", required_argument, 0, 'S'},
+        {"frame-cache", required_argument, 0, 'C'},
+        {"frame-cache-size", required_argument, 0, 'M'},
+        {"jobs", required_argument, 0, 'j'},
+        {"startup-trace", no_argument, 0, 'T'},
+        {"rgb565", no_argument, 0, 'R'},
+        {"config", required_argument, 0, 'o'},
+        {"input", required_argument, 0, 'I'},
+        {"next-bar", no_argument, 0, 'n'},
+        {"log-level", required_argument, 0, 'L'},
         {0},
     };
-    while ((opt = getopt_long(argc, argv, "f:H:F:B:hb", long_options,
+    while ((opt = getopt_long(argc, argv, "f:H:F:B:l:c:m:i:S:C:M:j:o:I:L:nRTshb", long_options,
                               &option_index)) != -1) {
         switch (opt) {
         case 'H':
-            config.height = atoi(optarg);
+            bar->height = atoi(optarg);
             break;
         case 'f':
-            strncpy(config.font, optarg, sizeof(config.font));
-            config.font[sizeof(config.font) - 1] = '\0';
+            if (config.n_fonts == WB_MAX_FONTS) {
+                fprintf(stderr, "at most %d fonts are supported\n",
+                        WB_MAX_FONTS);
+                return EXIT_FAILURE;
+            }
+            snprintf(config.fonts[config.n_fonts],
+                     sizeof(config.fonts[config.n_fonts]), "%s", optarg);
+            ++config.n_fonts;
             break;
         case 'b':
-            config.bottom = true;
+            bar->bottom = true;
+            break;
+        case 'I':
+            bar->input = optarg;
+            break;
+        case 'n':
+            if (config.n_bars == WB_MAX_BARS) {
+                fprintf(stderr, "at most %d bars are supported\n",
+                        WB_MAX_BARS);
+                return EXIT_FAILURE;
+            }
+            bar = &config.bars[config.n_bars++];
+            bar->height = DEFAULT_HEIGHT;
+            break;
+        case 'l':
+            config.max_status = strtoul(optarg, NULL, 10);
+            break;
+        case 'c':
+            config.text_cache = strtoul(optarg, NULL, 10);
+            break;
+        case 'm':
+            bar->format = optarg;
+            break;
+        case 's':
+            config.socket = true;
+            break;
+        case 'C':
+            config.frame_cache = strtoul(optarg, NULL, 10);
+            break;
+        case 'M':
+            config.frame_cache_size = strtoul(optarg, NULL, 10);
+            break;
+        case 'R':
+            config.rgb565 = true;
+            break;
+        case 'T':
+            trace = true;
+            break;
+        case 'L':
+            config.log_level = log_level_from_name(optarg);
+            if (config.log_level < 0) {
+                fprintf(stderr, "unknown log level '%s'\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'o':
+            config.config_path = optarg;
+            break;
+        case 'j':
+            config.workers = strtoul(optarg, NULL, 10);
+            break;
+        case 'S':
+            config.stats = strtoul(optarg, NULL, 10);
+            break;
+        case 'i':
+            config.interval = strtoul(optarg, NULL, 10);
             break;
         case 'F':
             config.fg_color = strtoul(optarg, NULL, 16);
@@ -78,7 +196,21 @@ int main(int argc, char *argv[]) {
         }
     }
 
+    if (config.n_fonts == 0) {
+        snprintf(config.fonts[0], sizeof(config.fonts[0]), DEFAULT_FONT);
+        config.n_fonts = 1;
+    }
+
+    char *default_path = NULL;
+    if (!config.config_path) {
+        config.config_path = default_path = config_default_path();
+    }
+
+    if (trace) {
+        stats_trace_start(start);
+    }
     wb_run(config);
+    free(default_path);
 
     return 0;
 }
@@ -0,0 +1,444 @@
+#include "modules.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "log.h"
+#include "wb.h"
+
+struct module_impl;
+
+struct module {
+    const struct module_impl *impl;
+    char *arg;  // text after the colon or NULL
+    size_t pos; // where the output goes in the literal text of the format
+    // files are opened once and re-read with pread on every tick
+    int fds[2];
+    uint64_t prev[2]; // counters of the last tick for rates
+    struct timespec prev_time;
+    char buf[128];
+    char *input; // text pushed to stdin and ipc modules
+    size_t input_cap;
+    const char *text; // output, usually buf
+    size_t len;
+};
+
+struct module_impl {
+    const char *name;
+    void (*init)(struct module *mod);
+    void (*update)(struct module *mod);
+};
+
+static int open_file(const char *fmt, ...) {
+    char path[256];
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(path, sizeof(path), fmt, args);
+    va_end(args);
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        log_warn("module could not open %s", path);
+    }
+    return fd;
+}
+
+// Reads the whole (small) file into buf and null terminates it.
+static ssize_t read_file(int fd, char *buf, size_t size) {
+    if (fd < 0) {
+        return -1;
+    }
+    ssize_t n = pread(fd, buf, size - 1, 0);
+    if (n < 0) {
+        return -1;
+    }
+    buf[n] = '\0';
+    return n;
+}
+
+static void set_output(struct module *mod, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(mod->buf, sizeof(mod->buf), fmt, args);
+    va_end(args);
+    mod->text = mod->buf;
+    mod->len = n < 0                        ? 0
+               : (size_t)n >= sizeof(mod->buf) ? sizeof(mod->buf) - 1
+                                               : (size_t)n;
+}
+
+static void clock_update(struct module *mod) {
+    time_t now = time(NULL);
+    struct tm tm;
+    localtime_r(&now, &tm);
+    mod->len = strftime(mod->buf, sizeof(mod->buf),
+                        mod->arg ? mod->arg : "%H:%M", &tm);
+    mod->text = mod->buf;
+}
+
+static void cpu_init(struct module *mod) {
+    mod->fds[0] = open_file("/proc/stat");
+}
+
+static void cpu_update(struct module *mod) {
+    char buf[256];
+    uint64_t v[8] = {0};
+    if (read_file(mod->fds[0], buf, sizeof(buf)) < 0 ||
+        sscanf(buf,
+               "cpu %" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64
+               " %" SCNu64 " %" SCNu64 " %" SCNu64,
+               &v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &v[6], &v[7]) < 4) {
+        return;
+    }
+
+    uint64_t total = 0;
+    for (int i = 0; i < 8; ++i) {
+        total += v[i];
+    }
+    uint64_t idle = v[3] + v[4]; // idle + iowait
+
+    uint64_t d_total = total - mod->prev[0], d_idle = idle - mod->prev[1];
+    mod->prev[0] = total;
+    mod->prev[1] = idle;
+    set_output(mod, "%" PRIu64 "%%",
+               d_total ? 100 * (d_total - d_idle) / d_total : 0);
+}
+
+static void mem_init(struct module *mod) {
+    mod->fds[0] = open_file("/proc/meminfo");
+}
+
+static void mem_update(struct module *mod) {
+    char buf[512];
+    if (read_file(mod->fds[0], buf, sizeof(buf)) < 0) {
+        return;
+    }
+    uint64_t total = 0, available = 0;
+    const char *p;
+    if ((p = strstr(buf, "MemTotal:"))) {
+        sscanf(p, "MemTotal: %" SCNu64, &total);
+    }
+    if ((p = strstr(buf, "MemAvailable:"))) {
+        sscanf(p, "MemAvailable: %" SCNu64, &available);
+    }
+    if (total) {
+        set_output(mod, "%" PRIu64 "%%", 100 * (total - available) / total);
+    }
+}
+
+static void load_init(struct module *mod) {
+    mod->fds[0] = open_file("/proc/loadavg");
+}
+
+static void load_update(struct module *mod) {
+    char buf[128];
+    if (read_file(mod->fds[0], buf, sizeof(buf)) < 0) {
+        return;
+    }
+    set_output(mod, "%.*s", (int)strcspn(buf, " "), buf);
+}
+
+static void battery_init(struct module *mod) {
+    mod->fds[0] = open_file("/sys/class/power_supply/%s/capacity",
+                            mod->arg ? mod->arg : "BAT0");
+}
+
+static void battery_update(struct module *mod) {
+    char buf[16];
+    if (read_file(mod->fds[0], buf, sizeof(buf)) < 0) {
+        return;
+    }
+    set_output(mod, "%d%%", atoi(buf));
+}
+
+static void net_init(struct module *mod) {
+    if (!mod->arg) {
+        log_fatal("the net module needs an interface, e.g. %%{net:eth0}");
+    }
+    mod->fds[0] = open_file("/sys/class/net/%s/statistics/rx_bytes", mod->arg);
+    mod->fds[1] = open_file("/sys/class/net/%s/statistics/tx_bytes", mod->arg);
+}
+
+static const char *format_rate(char *buf, size_t size, double rate) {
+    const char *units = "BKMG";
+    while (rate >= 1000 && units[1]) {
+        rate /= 1024;
+        ++units;
+    }
+    snprintf(buf, size, "%.*f%c", *units == 'B' ? 0 : 1, rate, *units);
+    return buf;
+}
+
+static void net_update(struct module *mod) {
+    char buf[32];
+    uint64_t bytes[2];
+    for (int i = 0; i < 2; ++i) {
+        if (read_file(mod->fds[i], buf, sizeof(buf)) < 0) {
+            return;
+        }
+        bytes[i] = strtoull(buf, NULL, 10);
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double elapsed = (now.tv_sec - mod->prev_time.tv_sec) +
+                     (now.tv_nsec - mod->prev_time.tv_nsec) / 1e9;
+
+    char rx[16] = "0B", tx[16] = "0B";
+    if (mod->prev_time.tv_sec && elapsed > 0) {
+        format_rate(rx, sizeof(rx), (bytes[0] - mod->prev[0]) / elapsed);
+        format_rate(tx, sizeof(tx), (bytes[1] - mod->prev[1]) / elapsed);
+    }
+    mod->prev[0] = bytes[0];
+    mod->prev[1] = bytes[1];
+    mod->prev_time = now;
+    set_output(mod, "%s/s %s/s", rx, tx);
+}
+
+static void file_init(struct module *mod) {
+    if (!mod->arg) {
+        log_fatal("the file module needs a path, e.g. %%{file:/tmp/status}");
+    }
+    mod->fds[0] = open_file("%s", mod->arg);
+}
+
+static void file_update(struct module *mod) {
+    if (read_file(mod->fds[0], mod->buf, sizeof(mod->buf)) < 0) {
+        return;
+    }
+    mod->text = mod->buf;
+    mod->len = strcspn(mod->buf, "\n");
+}
+
+static void ipc_init(struct module *mod) {
+    if (!mod->arg) {
+        log_fatal("the ipc module needs a name, e.g. %%{ipc:title}");
+    }
+}
+
+static const struct module_impl impls[] = {
+    {"clock", NULL, clock_update},
+    {"cpu", cpu_init, cpu_update},
+    {"mem", mem_init, mem_update},
+    {"load", load_init, load_update},
+    {"battery", battery_init, battery_update},
+    {"net", net_init, net_update},
+    {"file", file_init, file_update},
+    // filled by modules_set_stdin and modules_set
+    {"stdin", NULL, NULL},
+    {"ipc", ipc_init, NULL},
+};
+
+static const struct module_impl *find_impl(const char *name, size_t len) {
+    for (size_t i = 0; i < sizeof(impls) / sizeof(impls[0]); ++i) {
+        if (strlen(impls[i].name) == len &&
+            strncmp(impls[i].name, name, len) == 0) {
+            return &impls[i];
+        }
+    }
+    return NULL;
+}
+
+static void parse_format(struct modules *mods, const char *format) {
+    char *literal = malloc(strlen(format) + 1);
+    size_t literal_len = 0;
+
+    for (const char *p = format; *p; ++p) {
+        if (*p != '%') {
+            literal[literal_len++] = *p;
+            continue;
+        }
+
+        ++p;
+        if (*p == '%') {
+            literal[literal_len++] = '%';
+        } else if (*p == '|') {
+            literal[literal_len++] = ALIGNMENT_SEP;
+        } else if (*p == '{') {
+            const char *end = strchr(p, '}');
+            if (!end) {
+                log_fatal("unterminated module in format: %s", format);
+            }
+            const char *name = p + 1;
+            const char *colon = memchr(name, ':', end - name);
+            size_t name_len = (colon ? colon : end) - name;
+
+            const struct module_impl *impl = find_impl(name, name_len);
+            if (!impl) {
+                log_fatal("unknown module '%.*s'", (int)name_len, name);
+            }
+
+            mods->modules = realloc(mods->modules,
+                                    (mods->count + 1) * sizeof(*mods->modules));
+            struct module *mod = &mods->modules[mods->count++];
+            *mod = (struct module){
+                .impl = impl,
+                .arg = colon ? strndup(colon + 1, end - colon - 1) : NULL,
+                .pos = literal_len,
+                .fds = {-1, -1},
+            };
+            p = end;
+        } else {
+            log_fatal("invalid escape '%%%c' in format", *p ? *p : ' ');
+        }
+    }
+
+    mods->literal = literal;
+    mods->literal_len = literal_len;
+}
+
+// Arms the timer for the next multiple of the interval on the wall clock.
+// Setting the clock cancels it, see modules_tick().
+static void arm_timer(struct modules *mods) {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    uint64_t period = (uint64_t)mods->interval * 1000000;
+    uint64_t next = ((uint64_t)now.tv_sec * 1000000000 + now.tv_nsec) /
+                        period * period +
+                    period;
+    struct itimerspec its = {
+        .it_interval = {mods->interval / 1000,
+                        (mods->interval % 1000) * 1000000},
+        .it_value = {next / 1000000000, next % 1000000000},
+    };
+    if (timerfd_settime(mods->timer_fd,
+                        TFD_TIMER_ABSTIME | TFD_TIMER_CANCEL_ON_SET, &its,
+                        NULL) < 0) {
+        log_fatal("failed to arm timer");
+    }
+}
+
+struct modules *modules_create(const char *format, uint32_t interval) {
+    struct modules *mods = calloc(1, sizeof(*mods));
+    parse_format(mods, format);
+    mods->line_cap = 2 * mods->literal_len + 64;
+    mods->line = malloc(mods->line_cap);
+
+    for (size_t i = 0; i < mods->count; ++i) {
+        struct module *mod = &mods->modules[i];
+        if (mod->impl->init) {
+            mod->impl->init(mod);
+        }
+    }
+
+    // ticks are aligned to the wall clock so a clock changes on the second
+    mods->timer_fd =
+        timerfd_create(CLOCK_REALTIME, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (mods->timer_fd < 0) {
+        log_fatal("failed to create timer");
+    }
+    mods->interval = interval ? interval : 1;
+    arm_timer(mods);
+
+    // initial values so the first frame is not empty
+    modules_tick(mods);
+    return mods;
+}
+
+void modules_destroy(struct modules *mods) {
+    for (size_t i = 0; i < mods->count; ++i) {
+        struct module *mod = &mods->modules[i];
+        for (int j = 0; j < 2; ++j) {
+            if (mod->fds[j] >= 0) {
+                close(mod->fds[j]);
+            }
+        }
+        free(mod->arg);
+        free(mod->input);
+    }
+    close(mods->timer_fd);
+    free(mods->modules);
+    free(mods->literal);
+    free(mods->line);
+    free(mods);
+}
+
+void modules_tick(struct modules *mods) {
+    // nothing to drain on the initial tick. A clock set backwards would hold
+    // the ticks back until the old deadline, they follow the new time.
+    uint64_t expirations;
+    if (read(mods->timer_fd, &expirations, sizeof(expirations)) < 0 &&
+        errno == ECANCELED) {
+        arm_timer(mods);
+    }
+
+    for (size_t i = 0; i < mods->count; ++i) {
+        struct module *mod = &mods->modules[i];
+        if (mod->impl->update) {
+            mod->impl->update(mod);
+        }
+    }
+}
+
+static void push(struct module *mod, const char *text, size_t len) {
+    if (len > mod->input_cap) {
+        mod->input = realloc(mod->input, len);
+        mod->input_cap = len;
+    }
+    memcpy(mod->input, text, len);
+    mod->text = mod->input;
+    mod->len = len;
+}
+
+void modules_set_stdin(struct modules *mods, const char *line, size_t len) {
+    for (size_t i = 0; i < mods->count; ++i) {
+        struct module *mod = &mods->modules[i];
+        if (strcmp(mod->impl->name, "stdin") == 0) {
+            push(mod, line, len);
+        }
+    }
+}
+
+bool modules_set(struct modules *mods, const char *name, size_t name_len,
+                 const char *text, size_t len) {
+    bool found = false;
+    for (size_t i = 0; i < mods->count; ++i) {
+        struct module *mod = &mods->modules[i];
+        if (strcmp(mod->impl->name, "ipc") == 0 &&
+            strlen(mod->arg) == name_len &&
+            memcmp(mod->arg, name, name_len) == 0) {
+            push(mod, text, len);
+            found = true;
+        }
+    }
+    return found;
+}
+
+static void append(struct modules *mods, size_t *len, const char *text,
+                   size_t n) {
+    if (n == 0) {
+        return; // modules without output have no text
+    }
+    if (*len + n > mods->line_cap) {
+        mods->line_cap = (*len + n) * 2;
+        mods->line = realloc(mods->line, mods->line_cap);
+    }
+    memcpy(mods->line + *len, text, n);
+    *len += n;
+}
+
+bool modules_expand(struct modules *mods) {
+    // expand behind the previous line to compare against it
+    size_t start = mods->line_len, len = start, pos = 0;
+    for (size_t i = 0; i < mods->count; ++i) {
+        struct module *mod = &mods->modules[i];
+        append(mods, &len, mods->literal + pos, mod->pos - pos);
+        append(mods, &len, mod->text, mod->len);
+        pos = mod->pos;
+    }
+    append(mods, &len, mods->literal + pos, mods->literal_len - pos);
+
+    size_t n = len - start;
+    bool changed = n != start || memcmp(mods->line, mods->line + start, n);
+    memmove(mods->line, mods->line + start, n);
+    mods->line_len = n;
+    return changed;
+}
@@ -0,0 +1,45 @@
+#ifndef MODULES_H
+#define MODULES_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct module;
+
+// Built-in status sources refreshed by a timer and expanded into a status
+// line through a format string.
+//
+// The format is literal text with the following escapes:
+//   %{name} or %{name:arg}  output of a module
+//   %|                      separator between left, center and right
+//   %%                      a literal %
+struct modules {
+    int timer_fd;      // readable on every tick
+    uint32_t interval; // ms between ticks
+    struct module *modules;
+    size_t count;
+    char *literal; // format with the escapes resolved and modules removed
+    size_t literal_len;
+    char *line; // last expansion of the format
+    size_t line_len, line_cap;
+};
+
+// Exits on an invalid format. interval is in milliseconds.
+struct modules *modules_create(const char *format, uint32_t interval);
+void modules_destroy(struct modules *mods);
+
+// Drains the timer and refreshes every module.
+void modules_tick(struct modules *mods);
+
+// Sets the output of %{stdin} modules.
+void modules_set_stdin(struct modules *mods, const char *line, size_t len);
+
+// Sets the output of %{ipc:name} modules, returns whether there are any.
+bool modules_set(struct modules *mods, const char *name, size_t name_len,
+                 const char *text, size_t len);
+
+// Expands the format into line, returns whether it changed.
+bool modules_expand(struct modules *mods);
+
+#endif
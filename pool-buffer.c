@@ -1,75 +1,56 @@
 #include "pool-buffer.h"
 
-#include <assert.h>
-#include <errno.h>
-#include <fcntl.h>
 #include <pixman.h>
-#include <sys/mman.h>
-#include <time.h>
-#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
 #include <wayland-client.h>
 
-static void randname(char *buf) {
-    struct timespec ts;
-    clock_gettime(CLOCK_REALTIME, &ts);
-    long r = ts.tv_nsec;
-    for (int i = 0; i < 6; ++i) {
-        buf[i] = 'A' + (r & 15) + (r & 16) * 2;
-        r >>= 5;
-    }
-}
+#include "shm-arena.h"
 
-static int create_shm_file(void) {
-    int retries = 100;
-    do {
-        char name[] = "/wl_shm-XXXXXX";
-        randname(name + sizeof(name) - 7);
-        --retries;
-        int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
-        if (fd >= 0) {
-            shm_unlink(name);
-            return fd;
-        }
-    } while (retries > 0 && errno == EEXIST);
-    return -1;
+const struct buffer_format buffer_format_argb8888 = {
+    WL_SHM_FORMAT_ARGB8888, PIXMAN_a8r8g8b8, "ARGB8888"};
+const struct buffer_format buffer_format_xrgb8888 = {
+    WL_SHM_FORMAT_XRGB8888, PIXMAN_x8r8g8b8, "XRGB8888"};
+const struct buffer_format buffer_format_rgb565 = {WL_SHM_FORMAT_RGB565,
+                                                   PIXMAN_r5g6b5, "RGB565"};
+
+// bytes of a row, pixman wants whole 32 bit words
+static int buffer_stride(const struct buffer_format *format, uint32_t width) {
+    return (width * PIXMAN_FORMAT_BPP(format->pixman) / 8 + 3) & ~3;
 }
 
-int allocate_shm_file(size_t size) {
-    int fd = create_shm_file();
-    if (fd < 0)
-        return -1;
-    int ret;
-    do {
-        ret = ftruncate(fd, size);
-    } while (ret < 0 && errno == EINTR);
-    if (ret < 0) {
-        close(fd);
-        return -1;
+static void buffer_release(void *data, struct wl_buffer *wl_buffer) {
+    struct pool_buffer *pb = data;
+    pb->busy = false;
+    if (pb->pool->release) {
+        pb->pool->release(pb->pool->data);
     }
-    return fd;
 }
 
-void pool_buffer_create(struct pool_buffer *pb, struct wl_shm *shm,
-                        uint32_t width, uint32_t height) {
+static const struct wl_buffer_listener buffer_listener = {
+    .release = buffer_release,
+};
+
+void pool_buffer_create(struct pool_buffer *pb, struct shm_arena *arena,
+                        const struct buffer_format *format, uint32_t width,
+                        uint32_t height) {
+    pb->format = format;
     pb->width = width;
     pb->height = height;
 
-    int stride = width * 4;
+    int stride = buffer_stride(format, width);
     pb->size = stride * height;
 
-    int fd = allocate_shm_file(pb->size);
-    assert(fd != -1);
-
-    pb->data = mmap(NULL, pb->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
-    assert(pb->data != MAP_FAILED);
+    pb->arena = arena;
+    pb->block = shm_arena_alloc(arena, pb->size);
+    pb->data = (char *)arena->data + pb->block->offset;
 
-    struct wl_shm_pool *pool = wl_shm_create_pool(shm, fd, pb->size);
-    pb->buffer = wl_shm_pool_create_buffer(pool, 0, width, height, stride,
-                                           WL_SHM_FORMAT_ARGB8888);
-    wl_shm_pool_destroy(pool);
-    close(fd);
+    pb->buffer =
+        wl_shm_pool_create_buffer(arena->pool, pb->block->offset, width,
+                                  height, stride, format->shm);
+    wl_buffer_add_listener(pb->buffer, &buffer_listener, pb);
 
-    pb->pix = pixman_image_create_bits_no_clear(PIXMAN_a8r8g8b8, width, height,
+    pb->pix = pixman_image_create_bits_no_clear(format->pixman, width, height,
                                                 pb->data, stride);
 }
 
@@ -80,7 +61,88 @@ void pool_buffer_destroy(struct pool_buffer *buffer) {
     if (buffer->pix) {
         pixman_image_unref(buffer->pix);
     }
-    if (buffer->data) {
-        munmap(buffer->data, buffer->size);
+    if (buffer->block) {
+        shm_arena_free(buffer->arena, buffer->block);
+    }
+    memset(buffer, 0, sizeof(*buffer));
+}
+
+void buffer_pool_init(struct buffer_pool *pool, size_t count,
+                      size_t max_bytes, void (*release)(void *data),
+                      void *data) {
+    if (count < POOL_MIN_BUFFERS) {
+        count = POOL_MIN_BUFFERS;
+    }
+    pool->buffers = calloc(count, sizeof(*pool->buffers));
+    pool->count = count;
+    pool->max_bytes = max_bytes;
+    pool->release = release;
+    pool->data = data;
+}
+
+void buffer_pool_finish(struct buffer_pool *pool) {
+    for (size_t i = 0; i < pool->count; ++i) {
+        pool_buffer_destroy(&pool->buffers[i]);
+    }
+    free(pool->buffers);
+    memset(pool, 0, sizeof(*pool));
+}
+
+struct pool_buffer *pool_buffer_next(struct buffer_pool *pool,
+                                     struct shm_arena *arena,
+                                     const struct buffer_format *format,
+                                     uint32_t width, uint32_t height,
+                                     const struct render_layout *layout) {
+    static uint64_t clock;
+
+    size_t bytes = 0, allocated = 0;
+    struct pool_buffer *unused = NULL, *lru = NULL, *pb = NULL;
+    for (size_t i = 0; i < pool->count; ++i) {
+        struct pool_buffer *b = &pool->buffers[i];
+        if (!b->buffer) {
+            unused = unused ? unused : b;
+            continue;
+        }
+        bytes += b->size;
+        ++allocated;
+        if (b->busy) {
+            continue;
+        }
+        // a cached frame, nothing has to be drawn
+        if (b->format == format && b->width == width &&
+            b->height == height && render_layout_equal(&b->layout, layout)) {
+            pb = b;
+            break;
+        }
+        if (!lru || b->last_used < lru->last_used) {
+            lru = b;
+        }
+    }
+
+    if (!pb) {
+        // grow the cache while it fits and evict otherwise, but rather go
+        // over the limit than drop a frame
+        size_t size = (size_t)buffer_stride(format, width) * height;
+        if (unused && (allocated < POOL_MIN_BUFFERS ||
+                       bytes + size <= pool->max_bytes || !lru)) {
+            pb = unused;
+        } else {
+            pb = lru;
+        }
     }
+    if (!pb) {
+        return NULL;
+    }
+
+    if (pb->format != format || pb->width != width || pb->height != height) {
+        pool_buffer_destroy(pb);
+    }
+    if (!pb->buffer) {
+        pool_buffer_create(pb, arena, format, width, height);
+        pb->pool = pool;
+    }
+
+    pb->busy = true;
+    pb->last_used = ++clock;
+    return pb;
 }
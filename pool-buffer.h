@@ -2,19 +2,77 @@
 #define POOL_BUFFER_H
 
 #include <pixman.h>
+#include <stdbool.h>
 #include <wayland-client.h>
 
+#include "render.h"
+#include "shm-arena.h"
+
+// A wl_shm format with the pixman format drawing into it.
+struct buffer_format {
+    uint32_t shm; // enum wl_shm_format
+    pixman_format_code_t pixman;
+    const char *name;
+};
+
+extern const struct buffer_format buffer_format_argb8888;
+extern const struct buffer_format buffer_format_xrgb8888; // opaque
+extern const struct buffer_format buffer_format_rgb565;   // opaque, 16 bits
+
+struct buffer_pool;
+
 struct pool_buffer {
+    struct buffer_pool *pool;
     struct wl_buffer *buffer;
+    const struct buffer_format *format;
     uint32_t width, height;
     size_t size;
     void *data;
+    struct shm_arena *arena;
+    struct shm_block *block; // where data lives in the arena
     pixman_image_t *pix;
+    bool busy; // held by the compositor until wl_buffer.release
+    struct render_layout layout; // what was last drawn into the buffer
+    uint64_t last_used;          // for evicting the least recently used
+};
+
+// Buffers of a surface. Besides the ones needed to swap, every free buffer
+// is a cached frame that is shown again without drawing if its layout comes
+// back.
+struct buffer_pool {
+    struct pool_buffer *buffers;
+    size_t count;
+    size_t max_bytes; // memory the cached frames may take up
+    // called whenever the compositor releases one of the buffers
+    void (*release)(void *data);
+    void *data;
 };
 
-void pool_buffer_create(struct pool_buffer *pb, struct wl_shm *shm,
-                        uint32_t width, uint32_t height);
+// A pool always has room for this many buffers so it can swap, even if they
+// exceed max_bytes.
+#define POOL_MIN_BUFFERS 3
+
+void buffer_pool_init(struct buffer_pool *pool, size_t count,
+                      size_t max_bytes, void (*release)(void *data),
+                      void *data);
+
+void buffer_pool_finish(struct buffer_pool *pool);
+
+void pool_buffer_create(struct pool_buffer *pb, struct shm_arena *arena,
+                        const struct buffer_format *format, uint32_t width,
+                        uint32_t height);
 
 void pool_buffer_destroy(struct pool_buffer *buffer);
 
+// Returns a buffer from the pool that is not held by the compositor and
+// marks it busy, or NULL if every buffer is still busy. A free buffer that
+// already holds the layout is preferred, then an unused one as long as the
+// pool stays within its memory limit, then the least recently used one. The
+// buffer is recreated with the given format and dimensions if needed.
+struct pool_buffer *pool_buffer_next(struct buffer_pool *pool,
+                                     struct shm_arena *arena,
+                                     const struct buffer_format *format,
+                                     uint32_t width, uint32_t height,
+                                     const struct render_layout *layout);
+
 #endif
@@ -0,0 +1,85 @@
+#include "render.h"
+
+#include <pixman.h>
+#include <stdbool.h>
+
+static bool has_region(const struct render_layout *layout,
+                       const struct render_region *region) {
+    for (size_t i = 0; i < layout->count; ++i) {
+        const struct render_region *r = &layout->regions[i];
+        if (r->key == region->key && r->box.x1 == region->box.x1 &&
+            r->box.y1 == region->box.y1 && r->box.x2 == region->box.x2 &&
+            r->box.y2 == region->box.y2) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool render_layout_equal(const struct render_layout *a,
+                         const struct render_layout *b) {
+    if (!a->valid || !b->valid || a->width != b->width ||
+        a->height != b->height || a->count != b->count) {
+        return false;
+    }
+    for (size_t i = 0; i < a->count; ++i) {
+        if (!has_region(b, &a->regions[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void add_box(pixman_region32_t *region, const pixman_box32_t *box) {
+    pixman_region32_union_rect(region, region, box->x1, box->y1,
+                               box->x2 - box->x1, box->y2 - box->y1);
+}
+
+void render_layout_diff(const struct render_layout *old,
+                        const struct render_layout *new,
+                        pixman_region32_t *region) {
+    if (!old->valid || old->width != new->width ||
+        old->height != new->height) {
+        pixman_region32_union_rect(region, region, 0, 0, new->width,
+                                   new->height);
+        return;
+    }
+
+    // regions that appeared or moved need to be drawn, regions that
+    // disappeared or moved need to be cleared
+    for (size_t i = 0; i < new->count; ++i) {
+        if (!has_region(old, &new->regions[i])) {
+            add_box(region, &new->regions[i].box);
+        }
+    }
+    for (size_t i = 0; i < old->count; ++i) {
+        if (!has_region(new, &old->regions[i])) {
+            add_box(region, &old->regions[i].box);
+        }
+    }
+}
+
+void render_repaint(struct render_ctx *ctx, struct render_layout *current,
+                    const struct render_layout *layout,
+                    pixman_image_t *source, draw_callback_t draw,
+                    void *data) {
+    pixman_region32_t clip;
+    pixman_region32_init(&clip);
+    render_layout_diff(current, layout, &clip);
+
+    if (pixman_region32_not_empty(&clip)) {
+        pixman_image_set_clip_region32(ctx->pix, &clip);
+        if (source) {
+            pixman_image_composite32(PIXMAN_OP_SRC, source, NULL, ctx->pix, 0,
+                                     0, 0, 0, 0, 0, ctx->width, ctx->height);
+        } else {
+            ctx->clip = &clip;
+            draw(data, ctx);
+            ctx->clip = NULL;
+        }
+        pixman_image_set_clip_region32(ctx->pix, NULL);
+    }
+    pixman_region32_fini(&clip);
+
+    *current = *layout;
+}
@@ -0,0 +1,70 @@
+#ifndef RENDER_H
+#define RENDER_H
+
+#include <pixman.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define RENDER_MAX_REGIONS 8
+
+// Scales are fixed point numbers with this denominator, the same as the
+// preferred scale of wp_fractional_scale_v1.
+#define SCALE_BASE 120
+
+struct render_ctx {
+    uint32_t width, height;
+    uint32_t scale; // in units of 1/SCALE_BASE
+    pixman_image_t *pix;
+    int32_t x, y; // position of pix in the frame, layouts are in frame space
+    // area that has to be repainted, pix is clipped to it while drawing
+    pixman_region32_t *clip;
+    // thread the frame is laid out and drawn on, below the number of workers
+    unsigned worker;
+    // the background is already shown below, clear to transparent instead
+    bool transparent;
+};
+
+// A box of the frame whose pixels are fully determined by its key, anything
+// outside of the regions is background.
+struct render_region {
+    pixman_box32_t box;
+    uint64_t key;
+};
+
+// Describes the content of a frame so that two frames can be compared
+// without looking at their pixels.
+struct render_layout {
+    bool valid; // false if the content is unknown
+    uint32_t width, height;
+    size_t count;
+    struct render_region regions[RENDER_MAX_REGIONS];
+};
+
+// Describes the next frame. Called before every draw, on the same worker.
+// Callbacks of different workers run concurrently.
+typedef void (*layout_callback_t)(void *, struct render_ctx *,
+                                  struct render_layout *);
+// Repaints ctx->clip, which covers every region that differs from what the
+// image contained before. Both are in image space.
+typedef void (*draw_callback_t)(void *, struct render_ctx *);
+
+// Returns true if both layouts describe the same pixels.
+bool render_layout_equal(const struct render_layout *a,
+                         const struct render_layout *b);
+
+// Adds the area that differs between the two layouts to the region.
+void render_layout_diff(const struct render_layout *old,
+                        const struct render_layout *new,
+                        pixman_region32_t *region);
+
+// Brings ctx->pix from the frame described by current to the one described by
+// layout, and updates current. Only the difference is repainted, either by
+// calling draw or, if source is not NULL, by copying from an image that
+// already holds the new frame.
+void render_repaint(struct render_ctx *ctx, struct render_layout *current,
+                    const struct render_layout *layout,
+                    pixman_image_t *source, draw_callback_t draw,
+                    void *data);
+
+#endif
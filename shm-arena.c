@@ -0,0 +1,179 @@
+#define _GNU_SOURCE
+
+#include "shm-arena.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+#include <wayland-client.h>
+
+#include "log.h"
+
+// address space reserved up front so that growing never moves the mapping,
+// wl_shm_pool sizes are limited to an int32_t anyway
+#define ARENA_RESERVE ((size_t)1 << 30)
+#define ARENA_INITIAL (1 << 20)
+#define BLOCK_ALIGN 64
+
+static void randname(char *buf) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    long r = ts.tv_nsec;
+    for (int i = 0; i < 6; ++i) {
+        buf[i] = 'A' + (r & 15) + (r & 16) * 2;
+        r >>= 5;
+    }
+}
+
+// fallback for kernels without memfd_create
+static int create_shm_file(void) {
+    int retries = 100;
+    do {
+        char name[] = "/wl_shm-XXXXXX";
+        randname(name + sizeof(name) - 7);
+        --retries;
+        int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (fd >= 0) {
+            shm_unlink(name);
+            return fd;
+        }
+    } while (retries > 0 && errno == EEXIST);
+    return -1;
+}
+
+static int create_memfd(void) {
+    int fd = memfd_create("wb-shm", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd < 0) {
+        return create_shm_file();
+    }
+    // the compositor can rely on the pool never shrinking under it
+    fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK);
+    return fd;
+}
+
+static int resize_file(int fd, size_t size) {
+    int ret;
+    do {
+        ret = ftruncate(fd, size);
+    } while (ret < 0 && errno == EINTR);
+    return ret;
+}
+
+static struct shm_block *block_create(size_t offset, size_t size) {
+    struct shm_block *block = calloc(1, sizeof(*block));
+    block->offset = offset;
+    block->size = size;
+    block->free = true;
+    return block;
+}
+
+struct shm_arena *shm_arena_create(struct wl_shm *shm) {
+    struct shm_arena *arena = calloc(1, sizeof(*arena));
+    wl_list_init(&arena->blocks);
+
+    arena->fd = create_memfd();
+    if (arena->fd < 0 || resize_file(arena->fd, ARENA_INITIAL) < 0) {
+        log_fatal("failed to create shared memory");
+    }
+    arena->size = ARENA_INITIAL;
+
+    arena->data = mmap(NULL, ARENA_RESERVE, PROT_READ | PROT_WRITE,
+                       MAP_SHARED, arena->fd, 0);
+    if (arena->data == MAP_FAILED) {
+        log_fatal("failed to map shared memory");
+    }
+
+    arena->pool = wl_shm_create_pool(shm, arena->fd, arena->size);
+    wl_list_insert(&arena->blocks, &block_create(0, arena->size)->link);
+
+    return arena;
+}
+
+void shm_arena_destroy(struct shm_arena *arena) {
+    struct shm_block *block, *tmp;
+    wl_list_for_each_safe(block, tmp, &arena->blocks, link) {
+        wl_list_remove(&block->link);
+        free(block);
+    }
+    wl_shm_pool_destroy(arena->pool);
+    munmap(arena->data, ARENA_RESERVE);
+    close(arena->fd);
+    free(arena);
+}
+
+static void grow(struct shm_arena *arena, size_t needed) {
+    size_t size = arena->size;
+    while (size - arena->size < needed) {
+        size *= 2;
+    }
+    if (size > ARENA_RESERVE || resize_file(arena->fd, size) < 0) {
+        log_fatal("failed to grow shared memory to %zu bytes", size);
+    }
+    wl_shm_pool_resize(arena->pool, size);
+    log_debug("shm arena grown to %zu bytes", size);
+
+    // extend the last block if it is free, otherwise append one
+    struct shm_block *last = wl_container_of(arena->blocks.prev, last, link);
+    if (last->free) {
+        last->size += size - arena->size;
+    } else {
+        wl_list_insert(arena->blocks.prev,
+                       &block_create(arena->size, size - arena->size)->link);
+    }
+    arena->size = size;
+}
+
+struct shm_block *shm_arena_alloc(struct shm_arena *arena, size_t size) {
+    size = (size + BLOCK_ALIGN - 1) & ~(size_t)(BLOCK_ALIGN - 1);
+
+    // first fit, buffers of a bar come in a handful of sizes so this keeps
+    // fragmentation low
+    struct shm_block *block = NULL, *b;
+    wl_list_for_each(b, &arena->blocks, link) {
+        if (b->free && b->size >= size) {
+            block = b;
+            break;
+        }
+    }
+    if (!block) {
+        struct shm_block *last =
+            wl_container_of(arena->blocks.prev, last, link);
+        grow(arena, last->free ? size - last->size : size);
+        block = wl_container_of(arena->blocks.prev, block, link);
+    }
+
+    // split off the remainder
+    if (block->size > size) {
+        struct shm_block *rest =
+            block_create(block->offset + size, block->size - size);
+        wl_list_insert(&block->link, &rest->link);
+        block->size = size;
+    }
+    block->free = false;
+    return block;
+}
+
+void shm_arena_free(struct shm_arena *arena, struct shm_block *block) {
+    block->free = true;
+
+    // merge with free neighbours
+    if (block->link.next != &arena->blocks) {
+        struct shm_block *next = wl_container_of(block->link.next, next, link);
+        if (next->free) {
+            block->size += next->size;
+            wl_list_remove(&next->link);
+            free(next);
+        }
+    }
+    if (block->link.prev != &arena->blocks) {
+        struct shm_block *prev = wl_container_of(block->link.prev, prev, link);
+        if (prev->free) {
+            prev->size += block->size;
+            wl_list_remove(&block->link);
+            free(block);
+        }
+    }
+}
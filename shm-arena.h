@@ -0,0 +1,36 @@
+#ifndef SHM_ARENA_H
+#define SHM_ARENA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <wayland-client.h>
+
+// A range of the arena, blocks tile the whole arena in offset order.
+struct shm_block {
+    size_t offset, size;
+    bool free;
+    struct wl_list link;
+};
+
+// Shared memory for all buffers of a connection. A single memfd is mapped
+// once and shared with the compositor through a single wl_shm_pool that
+// only grows, buffers are carved out of it.
+struct shm_arena {
+    int fd;
+    void *data; // mapping of the whole reservation
+    size_t size;
+    struct wl_shm_pool *pool;
+    struct wl_list blocks; // shm_block::link
+};
+
+struct shm_arena *shm_arena_create(struct wl_shm *shm);
+
+void shm_arena_destroy(struct shm_arena *arena);
+
+// Returns a block of at least size bytes, growing the arena if no free block
+// is large enough.
+struct shm_block *shm_arena_alloc(struct shm_arena *arena, size_t size);
+
+void shm_arena_free(struct shm_arena *arena, struct shm_block *block);
+
+#endif
@@ -0,0 +1,120 @@
+#include "stats.h"
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+// Log-linear buckets, every power of two is split into 4 so a percentile is
+// off by at most 25%. 256 buckets cover the whole uint64_t range.
+#define SUB_BITS 2
+#define SUB_BUCKETS (1 << SUB_BITS)
+#define BUCKETS (64 * SUB_BUCKETS)
+
+struct histogram {
+    uint64_t count;
+    uint64_t max;
+    uint32_t buckets[BUCKETS];
+};
+
+static const char *stage_names[] = {
+    [STATS_READ] = "read",       [STATS_PARSE] = "parse",
+    [STATS_DECODE] = "decode",   [STATS_SHAPE] = "shape",
+    [STATS_COMPOSITE] = "composite", [STATS_COMMIT] = "commit",
+    [STATS_FRAME] = "frame",
+};
+
+static struct histogram stages[STATS_STAGES];
+static uint64_t counters[STATS_COUNTERS];
+static uint64_t trace_start; // 0 unless tracing
+
+static unsigned bucket_index(uint64_t v) {
+    if (v < SUB_BUCKETS) {
+        return v;
+    }
+    unsigned msb = 63 - __builtin_clzll(v);
+    unsigned sub = (v >> (msb - SUB_BITS)) & (SUB_BUCKETS - 1);
+    return (msb - SUB_BITS + 1) * SUB_BUCKETS + sub;
+}
+
+// largest value that falls into the bucket
+static uint64_t bucket_limit(unsigned i) {
+    if (i < SUB_BUCKETS) {
+        return i;
+    }
+    unsigned shift = i / SUB_BUCKETS - 1;
+    uint64_t lower = (uint64_t)(SUB_BUCKETS + i % SUB_BUCKETS) << shift;
+    return lower + ((uint64_t)1 << shift) - 1;
+}
+
+uint64_t stats_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void stats_record(enum stats_stage stage, uint64_t start) {
+    uint64_t ns = stats_now() - start;
+    struct histogram *h = &stages[stage];
+    // the draw workers record concurrently, a dump may see a count that is
+    // slightly ahead of the buckets
+    __atomic_fetch_add(&h->buckets[bucket_index(ns)], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&h->count, 1, __ATOMIC_RELAXED);
+    uint64_t max = __atomic_load_n(&h->max, __ATOMIC_RELAXED);
+    while (ns > max && !__atomic_compare_exchange_n(&h->max, &max, ns, true,
+                                                    __ATOMIC_RELAXED,
+                                                    __ATOMIC_RELAXED)) {
+    }
+}
+
+void stats_count(enum stats_counter counter) {
+    __atomic_fetch_add(&counters[counter], 1, __ATOMIC_RELAXED);
+}
+
+static uint64_t percentile(const struct histogram *h, unsigned p) {
+    uint64_t rank = (h->count * p + 99) / 100, seen = 0;
+    for (unsigned i = 0; i < BUCKETS; ++i) {
+        seen += h->buckets[i];
+        if (seen >= rank) {
+            uint64_t limit = bucket_limit(i);
+            return limit < h->max ? limit : h->max;
+        }
+    }
+    return h->max;
+}
+
+void stats_dump(void) {
+    fprintf(stderr, "%-10s %10s %10s %10s %10s\n", "stage", "count",
+            "p50 (us)", "p99 (us)", "max (us)");
+    for (int i = 0; i < STATS_STAGES; ++i) {
+        const struct histogram *h = &stages[i];
+        fprintf(stderr, "%-10s %10lu %10.1f %10.1f %10.1f\n", stage_names[i],
+                (unsigned long)h->count, percentile(h, 50) / 1e3,
+                percentile(h, 99) / 1e3, h->max / 1e3);
+    }
+    fprintf(stderr,
+            "frames: %lu rendered, %lu skipped, %lu dropped, %lu cached\n",
+            (unsigned long)counters[STATS_RENDERED],
+            (unsigned long)counters[STATS_SKIPPED],
+            (unsigned long)counters[STATS_DROPPED],
+            (unsigned long)counters[STATS_CACHED]);
+}
+
+void stats_trace_start(uint64_t start) {
+    trace_start = start;
+    stats_trace("start");
+}
+
+void stats_trace(const char *fmt, ...) {
+    if (!trace_start) {
+        return;
+    }
+    double ms = (stats_now() - trace_start) / 1e6;
+    char phase[128];
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(phase, sizeof(phase), fmt, args);
+    va_end(args);
+    fprintf(stderr, "startup: %9.3f ms  %s\n", ms, phase);
+}
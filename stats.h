@@ -0,0 +1,44 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+
+// Stages of getting a status onto the screen, timed with the monotonic clock.
+enum stats_stage {
+    STATS_READ,      // reading stdin
+    STATS_PARSE,     // splitting the status into spans
+    STATS_DECODE,    // utf-8 to utf-32 for shaping
+    STATS_SHAPE,     // rasterizing text runs
+    STATS_COMPOSITE, // drawing or copying a frame into a buffer
+    STATS_COMMIT,    // attaching, damaging and committing the surface
+    STATS_FRAME,     // everything a monitor does for a frame
+    STATS_STAGES,
+};
+
+enum stats_counter {
+    STATS_RENDERED, // frames committed
+    STATS_SKIPPED,  // frames with nothing to draw
+    STATS_DROPPED,  // frames without a free buffer
+    STATS_CACHED,   // surfaces showing a cached frame without drawing
+    STATS_COUNTERS,
+};
+
+// Monotonic time in nanoseconds.
+uint64_t stats_now(void);
+
+// Records the time since start, a stats_now() value, for the stage. Safe to
+// call from any thread, as is stats_count().
+void stats_record(enum stats_stage stage, uint64_t start);
+
+void stats_count(enum stats_counter counter);
+
+// Writes p50, p99 and max of every stage and the counters to stderr.
+void stats_dump(void);
+
+// Once started, stats_trace() prints the time since start, a stats_now()
+// value, and the phase to stderr. It does nothing otherwise.
+void stats_trace_start(uint64_t start);
+void stats_trace(const char *fmt, ...)
+    __attribute__((format(printf, 1, 2)));
+
+#endif
@@ -0,0 +1,132 @@
+#include "text-cache.h"
+
+#include <fcft/fcft.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wayland-client.h>
+
+#include "log.h"
+
+uint64_t hash_bytes(uint64_t seed, const void *data, size_t len) {
+    const unsigned char *p = data;
+    uint64_t h = seed ^ 0xcbf29ce484222325;
+    for (size_t i = 0; i < len; ++i) {
+        h ^= p[i];
+        h *= 0x100000001b3;
+    }
+    return h;
+}
+
+static struct text_cache_entry **bucket(struct text_cache *cache,
+                                        uint64_t hash) {
+    return &cache->buckets[hash & (cache->n_buckets - 1)];
+}
+
+static void entry_destroy(struct text_cache *cache,
+                          struct text_cache_entry *entry) {
+    struct text_cache_entry **p = bucket(cache, entry->hash);
+    while (*p != entry) {
+        p = &(*p)->next;
+    }
+    *p = entry->next;
+
+    wl_list_remove(&entry->link);
+    fcft_text_run_destroy(entry->run);
+    free(entry->text);
+    free(entry);
+    cache->count--;
+}
+
+void text_cache_init(struct text_cache *cache, size_t capacity) {
+    *cache = (struct text_cache){.capacity = capacity > 0 ? capacity : 1};
+    cache->n_buckets = 1;
+    while (cache->n_buckets < cache->capacity * 2) {
+        cache->n_buckets *= 2;
+    }
+    cache->buckets = calloc(cache->n_buckets, sizeof(*cache->buckets));
+    wl_list_init(&cache->lru);
+}
+
+void text_cache_finish(struct text_cache *cache) {
+    log_info("text cache: %lu hits, %lu misses", (unsigned long)cache->hits,
+             (unsigned long)cache->misses);
+
+    struct text_cache_entry *entry, *tmp;
+    wl_list_for_each_safe(entry, tmp, &cache->lru, link) {
+        entry_destroy(cache, entry);
+    }
+    free(cache->buckets);
+}
+
+const struct text_cache_entry *text_cache_get(struct text_cache *cache,
+                                              const struct fcft_font *font,
+                                              const char *text, size_t len) {
+    uint64_t hash = hash_bytes((uintptr_t)font, text, len);
+    for (struct text_cache_entry *e = *bucket(cache, hash); e; e = e->next) {
+        if (e->hash == hash && e->font == font && e->len == len &&
+            memcmp(e->text, text, len) == 0) {
+            // move to the front of the lru list
+            wl_list_remove(&e->link);
+            wl_list_insert(&cache->lru, &e->link);
+            cache->hits++;
+            return e;
+        }
+    }
+    cache->misses++;
+    return NULL;
+}
+
+const struct text_cache_entry *text_cache_put(struct text_cache *cache,
+                                              const struct fcft_font *font,
+                                              const char *text, size_t len,
+                                              struct fcft_text_run *run) {
+    if (cache->count == cache->capacity) {
+        struct text_cache_entry *oldest =
+            wl_container_of(cache->lru.prev, oldest, link);
+        entry_destroy(cache, oldest);
+    }
+
+    struct text_cache_entry *e = calloc(1, sizeof(*e));
+    e->hash = hash_bytes((uintptr_t)font, text, len);
+    e->font = font;
+    e->text = malloc(len);
+    memcpy(e->text, text, len);
+    e->len = len;
+    e->run = run;
+
+    // glyphs may draw outside of their advance, e.g. italics
+    int32_t pen = 0;
+    for (size_t i = 0; i < run->count; ++i) {
+        const struct fcft_glyph *g = run->glyphs[i];
+        if (pen + g->x < e->ink_x1) {
+            e->ink_x1 = pen + g->x;
+        }
+        if (pen + g->x + g->width > e->ink_x2) {
+            e->ink_x2 = pen + g->x + g->width;
+        }
+        pen += g->advance.x;
+    }
+    e->width = pen;
+    if (e->ink_x2 < pen) {
+        e->ink_x2 = pen;
+    }
+
+    struct text_cache_entry **b = bucket(cache, e->hash);
+    e->next = *b;
+    *b = e;
+    wl_list_insert(&cache->lru, &e->link);
+    cache->count++;
+
+    return e;
+}
+
+void text_cache_drop_font(struct text_cache *cache,
+                          const struct fcft_font *font) {
+    struct text_cache_entry *entry, *tmp;
+    wl_list_for_each_safe(entry, tmp, &cache->lru, link) {
+        if (entry->font == font) {
+            entry_destroy(cache, entry);
+        }
+    }
+}
@@ -0,0 +1,59 @@
+#ifndef TEXT_CACHE_H
+#define TEXT_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <wayland-client.h>
+
+struct fcft_font;
+struct fcft_text_run;
+
+struct text_cache_entry {
+    uint64_t hash;
+    const struct fcft_font *font;
+    char *text;
+    size_t len;
+
+    struct fcft_text_run *run;
+    int32_t width;          // sum of the glyph advances
+    int32_t ink_x1, ink_x2; // ink extents relative to the pen start
+
+    struct text_cache_entry *next; // hash chain
+    struct wl_list link;           // most recently used first
+};
+
+// Bounded LRU cache of shaped text runs keyed by text and font.
+struct text_cache {
+    size_t capacity, count;
+    size_t n_buckets; // power of two
+    struct text_cache_entry **buckets;
+    struct wl_list lru;
+
+    uint64_t hits, misses;
+};
+
+// 64-bit FNV-1a of the bytes, the seed tells apart otherwise equal keys
+uint64_t hash_bytes(uint64_t seed, const void *data, size_t len);
+
+void text_cache_init(struct text_cache *cache, size_t capacity);
+
+void text_cache_finish(struct text_cache *cache);
+
+// Returns the cached run for the text or NULL on a miss.
+const struct text_cache_entry *text_cache_get(struct text_cache *cache,
+                                              const struct fcft_font *font,
+                                              const char *text, size_t len);
+
+// Takes ownership of the run and measures it, evicting the least recently
+// used entry if the cache is full.
+const struct text_cache_entry *text_cache_put(struct text_cache *cache,
+                                              const struct fcft_font *font,
+                                              const char *text, size_t len,
+                                              struct fcft_text_run *run);
+
+// Drops every run shaped with the font, must be called before it is
+// destroyed since the runs reference its glyphs.
+void text_cache_drop_font(struct text_cache *cache,
+                          const struct fcft_font *font);
+
+#endif
@@ -0,0 +1,131 @@
+#include "utf8.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Widens the leading run of ascii bytes, returns how many bytes were
+// consumed. Status text is mostly ascii so this is where the time goes.
+static size_t decode_ascii(uint32_t *dst, const unsigned char *src,
+                           size_t len) {
+    size_t i = 0;
+#if defined(__AVX2__)
+    for (; i + 32 <= len; i += 32) {
+        __m256i chunk = _mm256_loadu_si256((const __m256i *)(src + i));
+        if (_mm256_movemask_epi8(chunk)) {
+            break;
+        }
+        for (int j = 0; j < 4; ++j) {
+            __m128i bytes = _mm_loadl_epi64((const __m128i *)(src + i + j * 8));
+            _mm256_storeu_si256((__m256i *)(dst + i + j * 8),
+                                _mm256_cvtepu8_epi32(bytes));
+        }
+    }
+#endif
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 16 <= len; i += 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)(src + i));
+        if (_mm_movemask_epi8(chunk)) {
+            break;
+        }
+        __m128i lo = _mm_unpacklo_epi8(chunk, zero);
+        __m128i hi = _mm_unpackhi_epi8(chunk, zero);
+        __m128i *out = (__m128i *)(dst + i);
+        _mm_storeu_si128(out + 0, _mm_unpacklo_epi16(lo, zero));
+        _mm_storeu_si128(out + 1, _mm_unpackhi_epi16(lo, zero));
+        _mm_storeu_si128(out + 2, _mm_unpacklo_epi16(hi, zero));
+        _mm_storeu_si128(out + 3, _mm_unpackhi_epi16(hi, zero));
+    }
+#else
+    // check eight bytes at a time for a set high bit
+    for (; i + 8 <= len; i += 8) {
+        uint64_t word;
+        memcpy(&word, src + i, sizeof(word));
+        if (word & 0x8080808080808080) {
+            break;
+        }
+        for (int j = 0; j < 8; ++j) {
+            dst[i + j] = src[i + j];
+        }
+    }
+#endif
+    for (; i < len && src[i] < 0x80; ++i) {
+        dst[i] = src[i];
+    }
+    return i;
+}
+
+// Decodes one non-ascii sequence, returns the number of bytes consumed. An
+// invalid sequence consumes its maximal subpart and yields U+FFFD.
+static size_t decode_sequence(uint32_t *cp, const unsigned char *s,
+                              size_t len) {
+    unsigned char c = s[0];
+    size_t n;
+    uint32_t v;
+    if (c >= 0xC2 && c <= 0xDF) {
+        n = 2;
+        v = c & 0x1F;
+    } else if (c >= 0xE0 && c <= 0xEF) {
+        n = 3;
+        v = c & 0x0F;
+    } else if (c >= 0xF0 && c <= 0xF4) {
+        n = 4;
+        v = c & 0x07;
+    } else {
+        *cp = UTF8_REPLACEMENT;
+        return 1;
+    }
+
+    // the range of the second byte excludes overlong encodings, surrogates
+    // and code points above U+10FFFF
+    unsigned char lo = 0x80, hi = 0xBF;
+    switch (c) {
+    case 0xE0:
+        lo = 0xA0;
+        break;
+    case 0xED:
+        hi = 0x9F;
+        break;
+    case 0xF0:
+        lo = 0x90;
+        break;
+    case 0xF4:
+        hi = 0x8F;
+        break;
+    }
+
+    for (size_t i = 1; i < n; ++i) {
+        if (i >= len || s[i] < lo || s[i] > hi) {
+            *cp = UTF8_REPLACEMENT;
+            return i;
+        }
+        v = (v << 6) | (s[i] & 0x3F);
+        lo = 0x80;
+        hi = 0xBF;
+    }
+
+    *cp = v;
+    return n;
+}
+
+size_t utf8_decode(uint32_t *dst, const char *src, size_t len) {
+    const unsigned char *s = (const unsigned char *)src;
+    size_t in = 0, out = 0;
+    while (in < len) {
+        size_t n = decode_ascii(dst + out, s + in, len - in);
+        in += n;
+        out += n;
+        if (in == len) {
+            break;
+        }
+        in += decode_sequence(&dst[out++], s + in, len - in);
+    }
+    return out;
+}
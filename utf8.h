@@ -0,0 +1,14 @@
+#ifndef UTF8_H
+#define UTF8_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define UTF8_REPLACEMENT 0xFFFD
+
+// Decodes len bytes of utf-8 into dst, which needs room for len code points.
+// Each maximal invalid subsequence is replaced by U+FFFD. Returns the number
+// of code points written.
+size_t utf8_decode(uint32_t *dst, const char *src, size_t len);
+
+#endif
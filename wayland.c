@@ -10,24 +10,89 @@
 
 #include "log.h"
 #include "pool-buffer.h"
+#include "shm-arena.h"
+#include "stats.h"
 #include "wlr-layer-shell-unstable-v1-client-protocol.h"
+#include "worker-pool.h"
 
 void noop() {}
 
+// One buffer brought up to date in the draw phase of a round.
+struct render_job {
+    struct render_ctx ctx;
+    struct pool_buffer *buffer;
+    struct monitor_surface *surface; // region of a split frame, else NULL
+    int32_t lx1, lx2;                // logical extent of the region
+    // contents of the buffer before and after drawing, meanwhile the buffer
+    // itself claims to be invalid so nothing copies from it
+    struct render_layout current, layout;
+    pixman_image_t *source; // copied from instead of drawing if not NULL
+    // a job of the round with the same layout, copied once it is drawn
+    const struct render_job *leader;
+};
+
+// A monitor rendered in the current round, worker i renders frames[i].
+struct render_frame {
+    struct wayland_monitor *mon;
+    uint64_t start;
+    struct render_ctx ctx;
+    struct render_layout layout;
+    struct render_job jobs[RENDER_MAX_REGIONS];
+    size_t n_jobs;
+    pixman_region32_t damage; // of a full frame
+};
+
+/* frame callback listener */
+static void frame_done(void *data, struct wl_callback *callback,
+                       uint32_t time) {
+    struct wayland_monitor *mon = data;
+    wl_callback_destroy(callback);
+    mon->frame_callback = NULL;
+    // a dirty monitor is drawn by the next wayland_render()
+}
+
+static const struct wl_callback_listener frame_listener = {
+    .done = frame_done,
+};
+
+// Lets the compositor skip what is behind the bar while its background is
+// opaque.
+static void set_opaque_region(struct wayland_monitor *mon) {
+    struct wl_region *region = NULL;
+    if (mon->wl->opaque) {
+        region = wl_compositor_create_region(mon->wl->compositor);
+        wl_region_add(region, 0, 0, mon->width, mon->height);
+    }
+    wl_surface_set_opaque_region(mon->surface, region);
+    if (region) {
+        wl_region_destroy(region);
+    }
+}
+
 /* layer surface listener */
 static void layer_surface_configure(void *data,
                                     struct zwlr_layer_surface_v1 *surface,
                                     uint32_t serial, uint32_t w, uint32_t h) {
     struct wayland_monitor *mon = data;
+    if (!mon->configured) {
+        stats_trace("monitor %s: configured", mon->name);
+    }
+    mon->configured = true;
     mon->width = w;
     mon->height = h;
     zwlr_layer_surface_v1_ack_configure(surface, serial);
+    set_opaque_region(mon);
+    schedule_render(mon);
 }
 
 static void layer_surface_closed(void *data,
                                  struct zwlr_layer_surface_v1 *surface) {
-    log_info("layer surface closed");
+    struct wayland_monitor *mon = data;
+    log_info("monitor %s: layer surface closed", mon->name);
     zwlr_layer_surface_v1_destroy(surface);
+    // the bar stays off this output, nothing is rendered or resized anymore
+    mon->layer_surface = NULL;
+    mon->configured = false;
 }
 
 struct zwlr_layer_surface_v1_listener layer_surface_listener = {
@@ -35,6 +100,26 @@ struct zwlr_layer_surface_v1_listener layer_surface_listener = {
     .closed = layer_surface_closed,
 };
 
+/* fractional scale listener */
+static void preferred_scale(void *data,
+                            struct wp_fractional_scale_v1 *fractional_scale,
+                            uint32_t scale) {
+    struct wayland_monitor *mon = data;
+    if (scale == mon->preferred_scale) {
+        return;
+    }
+    mon->preferred_scale = scale;
+    log_info("monitor %s: preferred scale %.3f", mon->name,
+             (double)scale / SCALE_BASE);
+
+    mon->wl->user_scale_callback(mon->bar->data, mon, scale);
+}
+
+static const struct wp_fractional_scale_v1_listener fractional_scale_listener =
+    {
+        .preferred_scale = preferred_scale,
+};
+
 /* wl_output listener */
 static void output_scale(void *data, struct wl_output *wl_output,
                          int32_t scale) {
@@ -48,19 +133,36 @@ static void output_scale(void *data, struct wl_output *wl_output,
         mon->layer_surface = zwlr_layer_shell_v1_get_layer_surface(
             mon->wl->layer_shell, mon->surface, mon->output, conf.layer, "wb");
         zwlr_layer_surface_v1_set_size(mon->layer_surface, conf.width,
-                                       conf.height);
-        zwlr_layer_surface_v1_set_exclusive_zone(mon->layer_surface, conf.zone);
-        zwlr_layer_surface_v1_set_anchor(mon->layer_surface, conf.anchor);
+                                       mon->bar->height);
+        zwlr_layer_surface_v1_set_exclusive_zone(mon->layer_surface,
+                                                 mon->bar->zone);
+        zwlr_layer_surface_v1_set_anchor(mon->layer_surface, mon->bar->anchor);
         zwlr_layer_surface_v1_set_margin(mon->layer_surface, conf.top,
                                          conf.right, conf.bottom, conf.left);
         zwlr_layer_surface_v1_add_listener(mon->layer_surface,
                                            &layer_surface_listener, mon);
 
+        // render at the exact fractional scale when the compositor supports
+        // it, the buffer is then scaled to the surface size by the viewport.
+        // Split frames scale the background with it.
+        if (mon->wl->fractional_scale_manager && mon->wl->viewporter) {
+            mon->fractional_scale =
+                wp_fractional_scale_manager_v1_get_fractional_scale(
+                    mon->wl->fractional_scale_manager, mon->surface);
+            wp_fractional_scale_v1_add_listener(
+                mon->fractional_scale, &fractional_scale_listener, mon);
+        }
+        if (mon->fractional_scale || mon->wl->split) {
+            mon->viewport =
+                wp_viewporter_get_viewport(mon->wl->viewporter, mon->surface);
+        }
+
+        // the configure is handled by the event loop, so the surfaces of all
+        // outputs are set up without waiting on each other
         wl_surface_commit(mon->surface);
-        wl_display_roundtrip(mon->wl->display);
     }
 
-    mon->wl->user_scale_callback(mon->wl->user_data, mon, scale);
+    mon->wl->user_scale_callback(mon->bar->data, mon, monitor_scale(mon));
 }
 
 static void output_name(void *data, struct wl_output *wl_output,
@@ -84,6 +186,46 @@ static const struct wl_output_listener output_listener = {
     .done = output_done,
 };
 
+/* wl_shm listener */
+static void shm_format(void *data, struct wl_shm *wl_shm, uint32_t format) {
+    struct wayland *wl = data;
+    // ARGB8888 and XRGB8888 are always supported
+    if (format == WL_SHM_FORMAT_RGB565) {
+        wl->shm_rgb565 = true;
+    }
+}
+
+static const struct wl_shm_listener shm_listener = {
+    .format = shm_format,
+};
+
+// a frame dropped for lack of a buffer is drawn as soon as one is free
+static void buffer_released(void *data) {
+    struct wayland_monitor *mon = data;
+    if (mon->starved) {
+        mon->starved = false;
+        schedule_render(mon);
+    }
+}
+
+static void add_monitor(struct wayland *wl, struct wayland_bar *bar,
+                        uint32_t name) {
+    struct wayland_monitor *mon = calloc(1, sizeof(struct wayland_monitor));
+    mon->wl = wl;
+    mon->bar = bar;
+    buffer_pool_init(&mon->pool, wl->ls_config.frame_cache,
+                     wl->ls_config.frame_cache_bytes, buffer_released, mon);
+    for (size_t i = 0; i < RENDER_MAX_REGIONS; ++i) {
+        buffer_pool_init(&mon->regions[i].pool, wl->ls_config.frame_cache,
+                         wl->ls_config.frame_cache_bytes, buffer_released,
+                         mon);
+    }
+    mon->output = wl_registry_bind(wl->registry, name, &wl_output_interface, 4);
+    wl_output_add_listener(mon->output, &output_listener, mon);
+
+    wl_list_insert(&wl->monitors, &mon->link);
+}
+
 /* registry listener */
 static void registry_global(void *data, struct wl_registry *wl_registry,
                             uint32_t name, const char *interface,
@@ -92,21 +234,32 @@ static void registry_global(void *data, struct wl_registry *wl_registry,
     struct wayland *wl = data;
     if (strcmp(interface, wl_shm_interface.name) == 0) {
         wl->shm = wl_registry_bind(wl_registry, name, &wl_shm_interface, 1);
+        wl_shm_add_listener(wl->shm, &shm_listener, wl);
     } else if (strcmp(interface, wl_compositor_interface.name) == 0) {
         wl->compositor =
             wl_registry_bind(wl_registry, name, &wl_compositor_interface, 4);
     } else if (strcmp(interface, wl_output_interface.name) == 0) {
-        struct wayland_monitor *mon = calloc(1, sizeof(struct wayland_monitor));
-        mon->wl = wl;
-        mon->output =
-            wl_registry_bind(wl_registry, name, &wl_output_interface, 4);
-        wl_output_add_listener(mon->output, &output_listener, mon);
-
-        wl_list_insert(&wl->monitors, &mon->link);
+        for (size_t i = 0; i < wl->n_bars; ++i) {
+            add_monitor(wl, &wl->bars[i], name);
+        }
     } else if (strcmp(interface, zwlr_layer_shell_v1_interface.name) == 0) {
         wl->layer_shell =
             wl_registry_bind(wl_registry, name, &zwlr_layer_shell_v1_interface,
                              version < 4 ? version : 4);
+    } else if (strcmp(interface,
+                      wp_fractional_scale_manager_v1_interface.name) == 0) {
+        wl->fractional_scale_manager = wl_registry_bind(
+            wl_registry, name, &wp_fractional_scale_manager_v1_interface, 1);
+    } else if (strcmp(interface, wp_viewporter_interface.name) == 0) {
+        wl->viewporter =
+            wl_registry_bind(wl_registry, name, &wp_viewporter_interface, 1);
+    } else if (strcmp(interface, wl_subcompositor_interface.name) == 0) {
+        wl->subcompositor =
+            wl_registry_bind(wl_registry, name, &wl_subcompositor_interface, 1);
+    } else if (strcmp(interface,
+                      wp_single_pixel_buffer_manager_v1_interface.name) == 0) {
+        wl->single_pixel_buffer_manager = wl_registry_bind(
+            wl_registry, name, &wp_single_pixel_buffer_manager_v1_interface, 1);
     }
 }
 
@@ -119,22 +272,33 @@ static const struct wl_registry_listener wl_registry_listener = {
 };
 
 struct wayland *wayland_create(struct wayland_layer_surface_config ls_config,
+                               const struct wayland_bar *bars, size_t n_bars,
                                scale_callback_t user_scale_callback,
-                               void *user_data) {
+                               layout_callback_t user_layout_callback,
+                               draw_callback_t user_draw_callback) {
     struct wayland *wl = calloc(1, sizeof(*wl));
     wl_list_init(&wl->monitors);
 
     // set user configuration
     wl->ls_config = ls_config;
+    wl->bars = calloc(n_bars, sizeof(*wl->bars));
+    memcpy(wl->bars, bars, n_bars * sizeof(*wl->bars));
+    wl->n_bars = n_bars;
     wl->user_scale_callback = user_scale_callback;
-    wl->user_data = user_data;
+    wl->user_layout_callback = user_layout_callback;
+    wl->user_draw_callback = user_draw_callback;
 
     // bind wayland globals
     wl->display = wl_display_connect(NULL);
+    if (!wl->display) {
+        log_fatal("failed to connect to the wayland display");
+    }
+    stats_trace("connected");
     wl->fd = wl_display_get_fd(wl->display);
     wl->registry = wl_display_get_registry(wl->display);
     wl_registry_add_listener(wl->registry, &wl_registry_listener, wl);
     wl_display_roundtrip(wl->display);
+    stats_trace("registry done");
 
     // make sure we have the required globals
     assert(wl->compositor);
@@ -142,8 +306,22 @@ struct wayland *wayland_create(struct wayland_layer_surface_config ls_config,
     assert(wl->shm);
     assert(!wl_list_empty(&wl->monitors));
 
-    // roundtrip so listeners added during the registry events are handled
+    // every buffer of every monitor is carved out of this
+    wl->arena = shm_arena_create(wl->shm);
+
+    wl->workers = worker_pool_create(ls_config.workers ? ls_config.workers : 1);
+    wl->frames = calloc(worker_pool_count(wl->workers), sizeof(*wl->frames));
+
+    wl->split = wl->subcompositor && wl->single_pixel_buffer_manager &&
+                wl->viewporter;
+
+    // roundtrip so listeners added during the registry events are handled,
+    // every output creates its layer surface meanwhile
     wl_display_roundtrip(wl->display);
+    stats_trace("outputs done");
+
+    // the shm formats are known now
+    wayland_set_background(wl, ls_config.background);
 
     log_info("wayland initialized");
     return wl;
@@ -154,49 +332,562 @@ void wayland_destroy(struct wayland *wl) {
     wl_list_for_each_safe(mon, tmp, &wl->monitors, link) {
         wl_list_remove(&mon->link);
 
+        if (mon->frame_callback) {
+            wl_callback_destroy(mon->frame_callback);
+        }
         wl_output_release(mon->output);
+        if (mon->fractional_scale) {
+            wp_fractional_scale_v1_destroy(mon->fractional_scale);
+        }
+        if (mon->viewport) {
+            wp_viewport_destroy(mon->viewport);
+        }
+        for (size_t i = 0; i < RENDER_MAX_REGIONS; ++i) {
+            struct monitor_surface *ms = &mon->regions[i];
+            if (ms->surface) {
+                wp_viewport_destroy(ms->viewport);
+                wl_subsurface_destroy(ms->subsurface);
+                wl_surface_destroy(ms->surface);
+            }
+            buffer_pool_finish(&ms->pool);
+        }
+        if (mon->layer_surface) {
+            zwlr_layer_surface_v1_destroy(mon->layer_surface);
+        }
         wl_surface_destroy(mon->surface);
-        zwlr_layer_surface_v1_destroy(mon->layer_surface);
-        pool_buffer_destroy(&mon->buffer);
+        buffer_pool_finish(&mon->pool);
         free(mon->name);
         free(mon);
     }
 
     // globals
+    if (wl->fractional_scale_manager) {
+        wp_fractional_scale_manager_v1_destroy(wl->fractional_scale_manager);
+    }
+    if (wl->viewporter) {
+        wp_viewporter_destroy(wl->viewporter);
+    }
+    if (wl->background) {
+        wl_buffer_destroy(wl->background);
+    }
+    if (wl->single_pixel_buffer_manager) {
+        wp_single_pixel_buffer_manager_v1_destroy(
+            wl->single_pixel_buffer_manager);
+    }
+    if (wl->subcompositor) {
+        wl_subcompositor_destroy(wl->subcompositor);
+    }
     zwlr_layer_shell_v1_destroy(wl->layer_shell);
     wl_registry_destroy(wl->registry);
+    shm_arena_destroy(wl->arena);
+    worker_pool_destroy(wl->workers);
+    free(wl->frames);
     wl_shm_destroy(wl->shm);
     wl_compositor_destroy(wl->compositor);
 
     wl_display_flush(wl->display);
     wl_display_disconnect(wl->display);
 
+    free(wl->bars);
     free(wl);
 
     log_info("wayland destroyed");
 }
 
-void render(struct wayland_monitor *mon, draw_callback_t draw,
-            void *draw_data) {
-    uint32_t width = mon->width * mon->scale;
-    uint32_t height = mon->height * mon->scale;
+// Returns a buffer of any monitor with the same configuration, including the
+// cached frames of this one, that already holds the pixels described by the
+// layout.
+static struct pool_buffer *find_drawn(struct wayland_monitor *mon,
+                                      const struct render_layout *layout) {
+    struct wayland_monitor *other;
+    wl_list_for_each(other, &mon->wl->monitors, link) {
+        if (monitor_scale(other) != monitor_scale(mon)) {
+            continue;
+        }
+        for (size_t i = 0; i <= RENDER_MAX_REGIONS; ++i) {
+            struct buffer_pool *pool = i < RENDER_MAX_REGIONS
+                                           ? &other->regions[i].pool
+                                           : &other->pool;
+            for (size_t j = 0; j < pool->count; ++j) {
+                struct pool_buffer *pb = &pool->buffers[j];
+                if (pb->buffer && pb->format == mon->wl->format &&
+                    render_layout_equal(&pb->layout, layout)) {
+                    return pb;
+                }
+            }
+        }
+    }
+    return NULL;
+}
+
+uint32_t monitor_scale(struct wayland_monitor *mon) {
+    if (mon->viewport && mon->preferred_scale) {
+        return mon->preferred_scale;
+    }
+    return mon->scale * SCALE_BASE;
+}
+
+// Claims the buffer for drawing the layout in this round.
+static struct render_job *add_job(struct render_frame *f,
+                                  struct pool_buffer *buffer,
+                                  const struct render_ctx *ctx,
+                                  const struct render_layout *layout) {
+    struct render_job *job = &f->jobs[f->n_jobs++];
+    *job = (struct render_job){
+        .ctx = *ctx,
+        .buffer = buffer,
+        .current = buffer->layout,
+        .layout = *layout,
+    };
+    job->ctx.pix = buffer->pix;
+    if (render_layout_equal(&buffer->layout, layout)) {
+        stats_count(STATS_CACHED);
+    }
+    buffer->layout.valid = false;
+    return job;
+}
+
+// Picks the buffer a full frame is drawn into, if anything changed.
+static void prepare_full(struct render_frame *f) {
+    struct wayland_monitor *mon = f->mon;
+
+    // the surface only needs to know what changed since the last commit
+    pixman_region32_init(&f->damage);
+    if (mon->front) {
+        render_layout_diff(&mon->front->layout, &f->layout, &f->damage);
+    } else {
+        pixman_region32_union_rect(&f->damage, &f->damage, 0, 0, f->ctx.width,
+                                   f->ctx.height);
+    }
+    if (!pixman_region32_not_empty(&f->damage)) {
+        stats_count(STATS_SKIPPED);
+        return;
+    }
+
+    // never draw into a buffer the compositor may still be reading from, a
+    // cached frame with the same layout needs no drawing at all
+    struct pool_buffer *buffer =
+        pool_buffer_next(&mon->pool, mon->wl->arena, mon->wl->format,
+                         f->ctx.width, f->ctx.height, &f->layout);
+    if (!buffer) {
+        log_warn("monitor %s: no free buffer, dropping frame", mon->name);
+        stats_count(STATS_DROPPED);
+        mon->starved = true;
+        return;
+    }
+
+    assert(buffer->buffer);
+    add_job(f, buffer, &f->ctx, &f->layout);
+}
+
+// Picks the buffer of a subsurface showing a region with a buffer just large
+// enough for it, if the region changed.
+static void prepare_region(struct render_frame *f, struct monitor_surface *ms,
+                           const struct render_region *region) {
+    struct wayland_monitor *mon = f->mon;
+
+    // snap to the logical pixel grid so the pixels land exactly where they
+    // would have been in a full frame
+    uint32_t scale = f->ctx.scale;
+    int32_t lx1 = region->box.x1 * SCALE_BASE / scale;
+    int32_t lx2 = (region->box.x2 * SCALE_BASE + scale - 1) / scale;
+    if (lx2 > (int32_t)mon->width) {
+        lx2 = mon->width;
+    }
+    int32_t x1 = (lx1 * scale + SCALE_BASE / 2) / SCALE_BASE;
+    int32_t x2 = (lx2 * scale + SCALE_BASE / 2) / SCALE_BASE;
+
+    // the region in the space of the buffer
+    struct render_layout layout = {
+        .valid = true,
+        .width = x2 - x1,
+        .height = f->ctx.height,
+        .count = 1,
+        .regions = {{
+            .box = {region->box.x1 - x1, region->box.y1, region->box.x2 - x1,
+                    region->box.y2},
+            .key = region->key,
+        }},
+    };
+    if (ms->front && ms->x == lx1 &&
+        render_layout_equal(&ms->front->layout, &layout)) {
+        return;
+    }
+
+    struct pool_buffer *buffer =
+        pool_buffer_next(&ms->pool, mon->wl->arena, mon->wl->format, x2 - x1,
+                         f->ctx.height, &layout);
+    if (!buffer) {
+        log_warn("monitor %s: no free buffer, dropping region", mon->name);
+        stats_count(STATS_DROPPED);
+        mon->starved = true;
+        return;
+    }
+
+    if (!ms->surface) {
+        ms->surface = wl_compositor_create_surface(mon->wl->compositor);
+        ms->subsurface = wl_subcompositor_get_subsurface(
+            mon->wl->subcompositor, ms->surface, mon->surface);
+        ms->viewport =
+            wp_viewporter_get_viewport(mon->wl->viewporter, ms->surface);
+    }
+
+    struct render_ctx ctx = {
+        .width = x2 - x1,
+        .height = f->ctx.height,
+        .scale = scale,
+        .x = x1,
+        .worker = f->ctx.worker,
+        // a translucent background would be blended twice, the parent
+        // surface shows it already
+        .transparent = !mon->wl->opaque,
+    };
+    struct render_job *job = add_job(f, buffer, &ctx, &layout);
+    job->surface = ms;
+    job->lx1 = lx1;
+    job->lx2 = lx2;
+}
+
+static void prepare_split(struct render_frame *f) {
+    for (size_t i = 0; i < f->layout.count; ++i) {
+        prepare_region(f, &f->mon->regions[i], &f->layout.regions[i]);
+    }
+}
+
+static void layout_frame(void *data, unsigned worker) {
+    struct render_frame *f = &((struct render_frame *)data)[worker];
+    struct wayland *wl = f->mon->wl;
+    wl->user_layout_callback(f->mon->bar->data, &f->ctx, &f->layout);
+}
+
+// The buffer may be several frames behind, everything that differs from its
+// own contents is repainted. Monitors with identical configurations only draw
+// a frame once, the others copy the pixels.
+static void draw_frame(void *data, unsigned worker) {
+    struct render_frame *f = &((struct render_frame *)data)[worker];
+    struct wayland *wl = f->mon->wl;
+    if (f->n_jobs == 0) {
+        return;
+    }
+
+    uint64_t start = stats_now();
+    for (size_t i = 0; i < f->n_jobs; ++i) {
+        struct render_job *job = &f->jobs[i];
+        if (!job->leader) {
+            render_repaint(&job->ctx, &job->current, &job->layout,
+                           job->source, wl->user_draw_callback,
+                           f->mon->bar->data);
+        }
+    }
+    stats_record(STATS_COMPOSITE, start);
+}
+
+// Copies the jobs whose layout another job of the round has just drawn.
+static void copy_frame(void *data, unsigned worker) {
+    struct render_frame *f = &((struct render_frame *)data)[worker];
+    struct wayland *wl = f->mon->wl;
+    uint64_t start = stats_now();
+    bool copied = false;
+    for (size_t i = 0; i < f->n_jobs; ++i) {
+        struct render_job *job = &f->jobs[i];
+        if (job->leader) {
+            render_repaint(&job->ctx, &job->current, &job->layout,
+                           job->leader->buffer->pix, wl->user_draw_callback,
+                           f->mon->bar->data);
+            copied = true;
+        }
+    }
+    if (copied) {
+        stats_record(STATS_COMPOSITE, start);
+    }
+}
+
+// Returns an earlier job of the round that draws the same pixels, or NULL.
+static const struct render_job *find_leader(struct render_frame *frames,
+                                            unsigned i, size_t j) {
+    const struct render_job *job = &frames[i].jobs[j];
+    for (unsigned fi = 0; fi <= i; ++fi) {
+        struct render_frame *f = &frames[fi];
+        for (size_t fj = 0; fj < (fi == i ? j : f->n_jobs); ++fj) {
+            const struct render_job *other = &f->jobs[fj];
+            if (!other->source && !other->leader &&
+                other->ctx.scale == job->ctx.scale &&
+                render_layout_equal(&other->layout, &job->layout)) {
+                return other;
+            }
+        }
+    }
+    return NULL;
+}
+
+// Attaches the drawn buffer and damages what changed, returns false if
+// nothing was drawn.
+static bool commit_full(struct render_frame *f) {
+    struct wayland_monitor *mon = f->mon;
+    if (f->n_jobs == 0) {
+        pixman_region32_fini(&f->damage);
+        return false;
+    }
+
+    struct render_job *job = &f->jobs[0];
+    job->buffer->layout = job->current;
+    mon->front = job->buffer;
+
+    if (mon->viewport) {
+        wp_viewport_set_destination(mon->viewport, mon->width, mon->height);
+    } else {
+        wl_surface_set_buffer_scale(mon->surface, mon->scale);
+    }
+    wl_surface_attach(mon->surface, job->buffer->buffer, 0, 0);
+
+    int n_rects;
+    pixman_box32_t *rects = pixman_region32_rectangles(&f->damage, &n_rects);
+    for (int i = 0; i < n_rects; ++i) {
+        wl_surface_damage_buffer(mon->surface, rects[i].x1, rects[i].y1,
+                                 rects[i].x2 - rects[i].x1,
+                                 rects[i].y2 - rects[i].y1);
+    }
+    pixman_region32_fini(&f->damage);
+    return true;
+}
+
+// Shows the background with a single pixel buffer and every region in a
+// subsurface of its own, returns false if nothing changed.
+static bool commit_split(struct render_frame *f) {
+    struct wayland_monitor *mon = f->mon;
+    bool changed = f->n_jobs > 0;
+    for (size_t i = 0; i < f->n_jobs; ++i) {
+        struct render_job *job = &f->jobs[i];
+        struct monitor_surface *ms = job->surface;
+        job->buffer->layout = job->current;
+
+        // subsurfaces are synchronized, all of this shows up with the parent
+        wl_subsurface_set_position(ms->subsurface, job->lx1, 0);
+        wp_viewport_set_destination(ms->viewport, job->lx2 - job->lx1,
+                                    mon->height);
+        wl_surface_attach(ms->surface, job->buffer->buffer, 0, 0);
+        wl_surface_damage_buffer(ms->surface, 0, 0, job->ctx.width,
+                                 job->ctx.height);
+        wl_surface_commit(ms->surface);
+        ms->front = job->buffer;
+        ms->x = job->lx1;
+    }
+    for (size_t i = f->layout.count; i < RENDER_MAX_REGIONS; ++i) {
+        struct monitor_surface *ms = &mon->regions[i];
+        if (ms->front) {
+            // unmaps the subsurface
+            wl_surface_attach(ms->surface, NULL, 0, 0);
+            wl_surface_commit(ms->surface);
+            ms->front = NULL;
+            changed = true;
+        }
+    }
+
+    if (mon->background != mon->wl->background ||
+        mon->split_width != mon->width || mon->split_height != mon->height) {
+        wl_surface_attach(mon->surface, mon->wl->background, 0, 0);
+        wl_surface_damage_buffer(mon->surface, 0, 0, 1, 1);
+        wp_viewport_set_destination(mon->viewport, mon->width, mon->height);
+        mon->background = mon->wl->background;
+        mon->split_width = mon->width;
+        mon->split_height = mon->height;
+        changed = true;
+    }
+
+    if (!changed) {
+        stats_count(STATS_SKIPPED);
+    }
+    return changed;
+}
+
+// Renders the first n frames, one on every worker. Buffers are picked and
+// committed on this thread in between.
+static void render_round(struct wayland *wl, unsigned n) {
+    struct render_frame *frames = wl->frames;
+    worker_pool_run(wl->workers, n, layout_frame, frames);
+
+    for (unsigned i = 0; i < n; ++i) {
+        if (wl->split) {
+            prepare_split(&frames[i]);
+        } else {
+            prepare_full(&frames[i]);
+        }
+    }
+    // sources are looked up once every buffer of the round is claimed, so
+    // none of them is drawn into or replaced while it is copied. Of the jobs
+    // with nothing to copy from, only the first of every layout draws.
+    bool copies = false;
+    for (unsigned i = 0; i < n; ++i) {
+        struct render_frame *f = &frames[i];
+        for (size_t j = 0; j < f->n_jobs; ++j) {
+            struct render_job *job = &f->jobs[j];
+            struct pool_buffer *drawn = find_drawn(f->mon, &job->layout);
+            job->source = drawn ? drawn->pix : NULL;
+            job->leader = drawn ? NULL : find_leader(frames, i, j);
+            copies |= job->leader != NULL;
+        }
+    }
+
+    worker_pool_run(wl->workers, n, draw_frame, frames);
+    if (copies) {
+        worker_pool_run(wl->workers, n, copy_frame, frames);
+    }
+
+    for (unsigned i = 0; i < n; ++i) {
+        struct render_frame *f = &frames[i];
+        struct wayland_monitor *mon = f->mon;
+        bool attached = wl->split ? commit_split(f) : commit_full(f);
+        if (!attached) {
+            continue;
+        }
+
+        uint64_t commit_start = stats_now();
+
+        // ask to be notified when it is a good time to draw the next frame
+        mon->frame_callback = wl_surface_frame(mon->surface);
+        wl_callback_add_listener(mon->frame_callback, &frame_listener, mon);
+        wl_surface_commit(mon->surface);
+
+        stats_record(STATS_COMMIT, commit_start);
+        stats_record(STATS_FRAME, f->start);
+        stats_count(STATS_RENDERED);
+        if (!mon->shown) {
+            stats_trace("monitor %s: first frame", mon->name);
+            mon->shown = true;
+        }
+    }
+}
+
+void wayland_render(struct wayland *wl) {
+    unsigned count = worker_pool_count(wl->workers), n = 0;
+    struct wayland_monitor *mon;
+    wl_list_for_each(mon, &wl->monitors, link) {
+        // a pending frame callback means the compositor has not shown the
+        // last frame yet, the newest content is drawn once it is done.
+        // Monitors that are hidden never get the callback and therefore stop
+        // drawing.
+        if (!mon->dirty || mon->frame_callback || !mon->configured ||
+            mon->starved) {
+            continue;
+        }
+        mon->dirty = false;
+
+        // buffer dimensions are rounded half away from zero as the
+        // fractional scale protocol asks for
+        uint32_t scale = monitor_scale(mon);
+        uint32_t width = (mon->width * scale + SCALE_BASE / 2) / SCALE_BASE;
+        uint32_t height = (mon->height * scale + SCALE_BASE / 2) / SCALE_BASE;
+
+        struct render_frame *f = &wl->frames[n];
+        f->mon = mon;
+        f->start = stats_now();
+        f->ctx = (struct render_ctx){
+            .width = width, .height = height, .scale = scale, .worker = n};
+        f->layout = (struct render_layout){
+            .valid = true, .width = width, .height = height};
+        f->n_jobs = 0;
+
+        if (++n == count) {
+            render_round(wl, n);
+            n = 0;
+        }
+    }
+    if (n > 0) {
+        render_round(wl, n);
+    }
+}
+
+// An opaque bar needs no alpha channel and the compositor can skip blending
+// it. RGB565 halves the memory again if asked for.
+static void choose_format(struct wayland *wl, uint32_t argb) {
+    const struct buffer_format *format = &buffer_format_argb8888;
+    wl->opaque = (argb >> 24) == 0xFF;
+    if (wl->opaque && wl->ls_config.compact && wl->shm_rgb565) {
+        format = &buffer_format_rgb565;
+    } else if (wl->opaque) {
+        format = &buffer_format_xrgb8888;
+    }
+    if (wl->ls_config.compact && format != &buffer_format_rgb565) {
+        log_warn("RGB565 needs an opaque background and compositor support");
+    }
+    if (format != wl->format) {
+        log_info("using %s buffers", format->name);
+        wl->format = format;
+    }
 
-    // check if buffer is out of date of output configuration
-    if (width != mon->buffer.width || height != mon->buffer.height) {
-        pool_buffer_destroy(&mon->buffer);
-        pool_buffer_create(&mon->buffer, mon->wl->shm, width, height);
+    struct wayland_monitor *mon;
+    wl_list_for_each(mon, &wl->monitors, link) {
+        if (mon->configured) {
+            set_opaque_region(mon);
+        }
     }
+}
 
-    assert(mon->buffer.buffer);
+void wayland_set_background(struct wayland *wl, uint32_t argb) {
+    choose_format(wl, argb);
 
-    struct render_ctx rctx = {
-        .pix = mon->buffer.pix, .width = width, .height = height};
+    // monitors redraw into buffers of the new format and attach the new
+    // background, whose proxy may well get the address of the old one
+    struct wayland_monitor *mon;
+    wl_list_for_each(mon, &wl->monitors, link) {
+        mon->background = NULL;
+        schedule_render(mon);
+    }
+
+    if (!wl->split) {
+        return;
+    }
+    if (wl->background) {
+        wl_buffer_destroy(wl->background);
+    }
 
-    // call the callback associated with an output
-    draw(draw_data, &rctx);
+    // premultiplied channels spanning the whole uint32_t range
+    uint32_t a = (argb >> 24) & 0xFF;
+    uint32_t r = ((argb >> 16) & 0xFF) * a / 0xFF;
+    uint32_t g = ((argb >> 8) & 0xFF) * a / 0xFF;
+    uint32_t b = (argb & 0xFF) * a / 0xFF;
+    wl->background = wp_single_pixel_buffer_manager_v1_create_u32_rgba_buffer(
+        wl->single_pixel_buffer_manager, r * 0x01010101, g * 0x01010101,
+        b * 0x01010101, a * 0x01010101);
+}
+
+void wayland_invalidate(struct wayland *wl) {
+    struct wayland_monitor *mon;
+    wl_list_for_each(mon, &wl->monitors, link) {
+        for (size_t i = 0; i <= RENDER_MAX_REGIONS; ++i) {
+            struct buffer_pool *pool = i < RENDER_MAX_REGIONS
+                                           ? &mon->regions[i].pool
+                                           : &mon->pool;
+            for (size_t j = 0; j < pool->count; ++j) {
+                pool->buffers[j].layout.valid = false;
+            }
+        }
+        schedule_render(mon);
+    }
+}
+
+void wayland_set_geometry(struct wayland *wl, size_t bar, uint32_t height,
+                          int32_t zone, uint32_t anchor) {
+    assert(bar < wl->n_bars);
+    struct wayland_bar *b = &wl->bars[bar];
+    b->height = height;
+    b->zone = zone;
+    b->anchor = anchor;
+
+    // the surfaces stay, the new size arrives with the next configure
+    struct wayland_monitor *mon;
+    wl_list_for_each(mon, &wl->monitors, link) {
+        if (mon->bar != b || !mon->layer_surface) {
+            continue;
+        }
+        zwlr_layer_surface_v1_set_size(mon->layer_surface, wl->ls_config.width,
+                                       b->height);
+        zwlr_layer_surface_v1_set_exclusive_zone(mon->layer_surface, b->zone);
+        zwlr_layer_surface_v1_set_anchor(mon->layer_surface, b->anchor);
+        wl_surface_commit(mon->surface);
+    }
+}
 
-    wl_surface_set_buffer_scale(mon->surface, mon->scale);
-    wl_surface_attach(mon->surface, mon->buffer.buffer, 0, 0);
-    wl_surface_damage(mon->surface, 0, 0, mon->width, mon->height);
-    wl_surface_commit(mon->surface);
+void schedule_render(struct wayland_monitor *mon) {
+    mon->dirty = true;
 }
@@ -7,37 +7,84 @@
 #include <wayland-client.h>
 
 #include "pool-buffer.h"
+#include "render.h"
+#include "fractional-scale-v1-client-protocol.h"
+#include "single-pixel-buffer-v1-client-protocol.h"
+#include "viewporter-client-protocol.h"
 #include "wlr-layer-shell-unstable-v1-client-protocol.h"
 
-struct render_ctx {
-    uint32_t width, height;
-    pixman_image_t *pix;
+// A subsurface showing one region of the layout when frames are split.
+struct monitor_surface {
+    struct wl_surface *surface;
+    struct wl_subsurface *subsurface;
+    struct wp_viewport *viewport;
+    int32_t x; // logical position on the monitor surface
+    struct buffer_pool pool;
+    struct pool_buffer *front; // NULL while hidden
+};
+
+// A bar gets a layer surface of its own on every output.
+struct wayland_bar {
+    uint32_t height;
+    uint32_t anchor;
+    int32_t zone;
+    void *data; // passed to the callbacks of its monitors
 };
 
+// One bar on one output. Every bar binds the outputs itself, so the
+// monitors of an output do not depend on each other.
 struct wayland_monitor {
     struct wayland *wl;
+    struct wayland_bar *bar;
 
     struct wl_output *output;
     char *name;
-    int32_t scale;
+    int32_t scale;            // integer scale of the output
+    uint32_t preferred_scale; // fractional scale of the surface, 0 if unknown
 
     struct wl_surface *surface;
     struct zwlr_layer_surface_v1 *layer_surface;
+    struct wp_fractional_scale_v1 *fractional_scale;
+    struct wp_viewport *viewport;
+    bool configured;        // the layer surface got its first configure
+    bool shown;             // a frame was committed
     uint32_t width, height; // dimensions of surface
-    struct pool_buffer buffer;
+    struct buffer_pool pool;
+    struct pool_buffer *front; // last buffer committed to the surface
+    // split frames, the surface only shows the background and every region
+    // is a subsurface with a buffer of its own
+    struct monitor_surface regions[RENDER_MAX_REGIONS];
+    struct wl_buffer *background;       // attached single pixel buffer
+    uint32_t split_width, split_height; // logical size last committed
+
+    // set when the content changed; cleared once a frame is committed
+    bool dirty;
+    // a frame was dropped because every buffer was busy, the next release
+    // draws it again
+    bool starved;
+    // pending wl_surface.frame callback, drawing waits until it is done
+    struct wl_callback *frame_callback;
 
     struct wl_list link;
 };
 
+// Called whenever the scale a monitor renders at changes, scale is in units
+// of 1/SCALE_BASE.
 typedef void (*scale_callback_t)(void *data, struct wayland_monitor *mon,
-                                 int32_t scale);
+                                 uint32_t scale);
 
+// Shared by the layer surfaces of all bars.
 struct wayland_layer_surface_config {
     uint32_t layer;
-    uint32_t width, height;
-    uint32_t anchor;
+    uint32_t width;
     int32_t top, right, bottom, left;
-    int32_t zone;
+    uint32_t background; // ARGB, shown behind the regions of split frames
+    // buffers kept per surface to show repeating frames without drawing,
+    // and the memory they may use
+    uint32_t frame_cache;
+    size_t frame_cache_bytes;
+    bool compact; // RGB565 buffers if the background is opaque
+    uint32_t workers; // threads laying out and drawing monitors in parallel
 };
 
 struct wayland {
@@ -45,23 +92,68 @@ struct wayland {
     struct wl_display *display;
     struct wl_registry *registry;
     struct wl_shm *shm;
+    bool shm_rgb565; // advertised by wl_shm
+    struct shm_arena *arena;
+    const struct buffer_format *format; // of every buffer
+    bool opaque;                        // the background is opaque
     struct wl_compositor *compositor;
     struct zwlr_layer_shell_v1 *layer_shell;
+    // optional, fractional scaling needs both
+    struct wp_fractional_scale_manager_v1 *fractional_scale_manager;
+    struct wp_viewporter *viewporter;
+    // optional, frames are split into a background and subsurfaces with all
+    // of them and the viewporter
+    struct wl_subcompositor *subcompositor;
+    struct wp_single_pixel_buffer_manager_v1 *single_pixel_buffer_manager;
+    bool split;
+    struct wl_buffer *background; // single pixel buffer
     struct wl_list monitors;
+    struct wayland_bar *bars;
+    size_t n_bars;
+
+    // monitors are rendered in rounds of one per worker
+    struct worker_pool *workers;
+    struct render_frame *frames; // one per worker
 
     struct wayland_layer_surface_config ls_config;
-    void *user_data;
     scale_callback_t user_scale_callback;
+    layout_callback_t user_layout_callback;
+    draw_callback_t user_draw_callback;
 };
 
-typedef void (*draw_callback_t)(void *, struct render_ctx *);
+// Returns the scale the monitor renders at in units of 1/SCALE_BASE, the
+// preferred fractional scale if known and the integer output scale otherwise.
+uint32_t monitor_scale(struct wayland_monitor *mon);
+
+// Marks the monitor dirty. The frame is drawn by the next wayland_render()
+// once the surface is configured and idle.
+void schedule_render(struct wayland_monitor *mon);
 
-void render(struct wayland_monitor *mon, draw_callback_t draw, void *draw_data);
+// Forgets what every buffer holds so the next frames are drawn from scratch,
+// for changes the layouts do not capture such as the background.
+void wayland_invalidate(struct wayland *wl);
 
+// Changes the height, exclusive zone and anchor of the layer surfaces of a
+// bar in place.
+void wayland_set_geometry(struct wayland *wl, size_t bar, uint32_t height,
+                          int32_t zone, uint32_t anchor);
+
+// Renders every dirty monitor without a pending frame callback. Layout and
+// drawing run on the workers, everything touching wayland on the calling
+// thread.
+void wayland_render(struct wayland *wl);
+
+// Shows n_bars bars on every output, the callbacks get the data of the bar.
 struct wayland *wayland_create(struct wayland_layer_surface_config ls_config,
+                               const struct wayland_bar *bars, size_t n_bars,
                                scale_callback_t user_scale_callback,
-                               void *user_data);
+                               layout_callback_t user_layout_callback,
+                               draw_callback_t user_draw_callback);
 
 void wayland_destroy(struct wayland *ctx);
 
+// Changes the background color, which picks the buffer format and is shown
+// behind the regions of split frames.
+void wayland_set_background(struct wayland *wl, uint32_t argb);
+
 #endif
@@ -2,325 +2,461 @@
 
 #include <assert.h>
 #include <fcft/fcft.h>
-#include <fontconfig/fontconfig.h>
-#include <pixman.h>
+#include <fcntl.h>
 #include <poll.h>
+#include <signal.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <uchar.h>
+#include <sys/signalfd.h>
+#include <sys/stat.h>
+#include <sys/timerfd.h>
 #include <unistd.h>
 #include <wayland-client.h>
 
+#include "config.h"
+#include "draw.h"
 #include "log.h"
+#include "stats.h"
+#include "text-cache.h"
 #include "wayland.h"
 #include "wlr-layer-shell-unstable-v1-client-protocol.h"
 
-#define ALIGNMENT_SEP '\x1f'
-
-static pixman_color_t argb_to_pixman(uint32_t argb) {
-    uint16_t a = (argb >> 24) & 0xFF;
-    uint16_t r = (argb >> 16) & 0xFF;
-    uint16_t g = (argb >> 8) & 0xFF;
-    uint16_t b = (argb >> 0) & 0xFF;
-    // premultiplies
-    pixman_color_t color = {
-        (r << 8) * a / 0xFF,
-        (g << 8) * a / 0xFF,
-        (b << 8) * a / 0xFF,
-        a << 8,
-    };
-
-    return color;
+static uint32_t layer_anchor(const struct wb_bar_config *config) {
+    return (config->bottom ? ZWLR_LAYER_SURFACE_V1_ANCHOR_BOTTOM
+                           : ZWLR_LAYER_SURFACE_V1_ANCHOR_TOP) |
+           ZWLR_LAYER_SURFACE_V1_ANCHOR_LEFT |
+           ZWLR_LAYER_SURFACE_V1_ANCHOR_RIGHT;
 }
 
-size_t mbsntoc32(char32_t *dst, const char *src, size_t nms, size_t len) {
-    mbstate_t ps = {0};
-
-    char32_t *out = dst;
-    const char *in = src;
-
-    size_t consumed = 0;
-    size_t chars = 0;
-    size_t rc;
-
-    while ((out == NULL || chars < len) && consumed < nms &&
-           (rc = mbrtoc32(out, in, nms - consumed, &ps)) != 0) {
-        switch (rc) {
-        case 0:
-            goto done;
-
-        case (size_t)-1:
-        case (size_t)-2:
-        case (size_t)-3:
-            goto err;
+// Schedules the monitors showing the bar.
+static void schedule_bar(struct wb_bar *bar) {
+    struct wayland_monitor *mon;
+    wl_list_for_each(mon, &bar->wb->wl->monitors, link) {
+        if (mon->bar->data == bar) {
+            schedule_render(mon);
         }
-
-        in += rc;
-        consumed += rc;
-        chars++;
-
-        if (out != NULL)
-            out++;
     }
+}
 
-done:
-    return chars;
-
-err:
-    return (size_t)-1;
+static void update_status(struct wb_bar *bar, const char *line, size_t len) {
+    uint64_t start = stats_now();
+    set_status(bar, line, len);
+    stats_record(STATS_PARSE, start);
+    schedule_bar(bar);
 }
 
-enum align { ALIGN_START, ALIGN_CENTER, ALIGN_END };
-
-static void draw_text(struct fcft_font *font, pixman_image_t *pix,
-                      pixman_color_t *color, const char *cstr, int32_t x,
-                      int32_t y, enum align horiz, enum align vert) {
-    size_t len = strlen(cstr);
-    if (len == 0) {
-        return;
-    }
-
-    char32_t str32[len];
-    size_t n = mbsntoc32(str32, cstr, len + 1, len);
-    if (n == (size_t)-1) {
-        log_fatal("failed to convert multi-byte string to wchar_t string");
-    }
-    struct fcft_text_run *text_run =
-        fcft_rasterize_text_run_utf32(font, n, str32, FCFT_SUBPIXEL_NONE);
-    assert(text_run);
-
-    // calculate width of the run
-    int run_width = 0;
-    for (int i = 0; i < text_run->count; ++i) {
-        const struct fcft_glyph *g = text_run->glyphs[i];
-        run_width += g->advance.x;
-    }
-
-    switch (horiz) {
-    case ALIGN_START:
-        break;
-    case ALIGN_CENTER:
-        x -= run_width / 2;
-        break;
-    case ALIGN_END:
-        x -= run_width;
-        break;
-    }
-
-    switch (vert) {
-    case ALIGN_START:
-        y += font->ascent;
-        break;
-    case ALIGN_CENTER:
-        y += (font->ascent + font->descent) / 2.0 -
-             (font->descent > 0 ? font->descent : 0);
-        break;
-    case ALIGN_END:
-        break;
-    }
-
-    pixman_image_t *clr_pix = pixman_image_create_solid_fill(color);
-
-    // render each glyph
-    for (int i = 0; i < text_run->count; ++i) {
-        const struct fcft_glyph *g = text_run->glyphs[i];
-        if (g->is_color_glyph) {
-            pixman_image_composite32(PIXMAN_OP_OVER, g->pix, NULL, pix, 0, 0, 0,
-                                     0, x + g->x, y - g->y, g->width,
-                                     g->height);
-        } else {
-            pixman_image_composite32(PIXMAN_OP_OVER, clr_pix, g->pix, pix, 0, 0,
-                                     0, 0, x + g->x, y - g->y, g->width,
-                                     g->height);
-        }
-        x += g->advance.x;
+static void update_modules(struct wb_bar *bar) {
+    if (modules_expand(bar->modules)) {
+        update_status(bar, bar->modules->line, bar->modules->line_len);
     }
-    pixman_image_unref(clr_pix);
-    fcft_text_run_destroy(text_run);
 }
 
-static void draw_bar(void *data, struct render_ctx *ctx) {
-    struct wb *bar = data;
-
-    // Fill background with a color
-    pixman_color_t bg = argb_to_pixman(bar->config.bg_color);
-    pixman_image_fill_rectangles(
-        PIXMAN_OP_SRC, ctx->pix, &bg, 1,
-        &(pixman_rectangle16_t){0, 0, ctx->width, ctx->height});
-
-    // draw text
-    pixman_color_t fg = argb_to_pixman(bar->config.fg_color);
-    const char *status = bar->status;
-    for (int i = 0; i < 3 && *status; ++i) {
-        // find position of seperator or null terminator
-        const char *end = &status[strcspn(status, "\x1f")];
-        // len does not include seperator or null terminator
-        size_t len = end - status;
-        char comp[len + 1];
-        memcpy(comp, status, len);
-        comp[len] = '\0';
-
-        enum align horiz = ALIGN_START;
-        int32_t x = 0;
-        switch (i) {
-        case 1:
-            horiz = ALIGN_CENTER;
-            x = ctx->width / 2;
-            break;
-        case 2:
-            horiz = ALIGN_END;
-            x = ctx->width;
-            break;
+static bool fonts_equal(const struct wb_config *a, const struct wb_config *b) {
+    if (a->n_fonts != b->n_fonts) {
+        return false;
+    }
+    for (size_t i = 0; i < a->n_fonts; ++i) {
+        if (strcmp(a->fonts[i], b->fonts[i]) != 0) {
+            return false;
         }
-
-        draw_text(bar->font, ctx->pix, &fg, comp, x, ctx->height / 2, horiz,
-                  ALIGN_CENTER);
-
-        // +1 if we haven't reached the end of the status string
-        status += len + (*end == ALIGNMENT_SEP);
     }
-
-    // sanity check to ensure no buffer overflow
-    assert(status <= strchr(bar->status, '\0'));
+    return true;
 }
 
-// Expects a pointer to a heap allocated string and will reallocate the given
-// string in order to append the formatted string
-static void strappf(char **cstr_ptr, const char *fmt, ...) {
-    va_list args;
-    va_start(args, fmt);
-    int attr_len = vsnprintf(NULL, 0, fmt, args);
-    va_end(args);
-
-    assert(attr_len >= 0);
-
-    // allocate space for attribute
-    *cstr_ptr = realloc(*cstr_ptr, strlen(*cstr_ptr) + attr_len + 1);
-
-    // format
-    char attr[attr_len + 1];
-    va_start(args, fmt);
-    vsnprintf(attr, sizeof(attr), fmt, args);
-    va_end(args);
+// Applies the config file again without recreating surfaces, only what
+// changed is redone.
+static void reload_config(struct wb *wb) {
+    // the prefetch thread reads the fonts of the config
+    wait_prefetch(wb);
+
+    struct wb_config old = wb->config;
+    wb->config = wb->base;
+    if (config_load(&wb->config, wb->config.config_path)) {
+        log_info("reloaded %s", wb->config.config_path);
+    } else {
+        log_info("%s is gone, using the command line",
+                 wb->config.config_path);
+    }
+    struct wb_config *config = &wb->config;
+    log_set_level(config->log_level);
+
+    // without any font nothing could be drawn, the loaded ones stay
+    bool fonts = !fonts_equal(&old, config);
+    if (fonts && (config->n_fonts == 0 || !reload_fonts(wb, &old))) {
+        memcpy(config->fonts, old.fonts, sizeof(config->fonts));
+        config->n_fonts = old.n_fonts;
+        fonts = false;
+    }
+    bool fg = old.fg_color != config->fg_color;
+    bool bg = old.bg_color != config->bg_color;
+
+    // spans take the default colors and check font indices while parsing
+    if (fonts || fg || bg) {
+        for (size_t i = 0; i < wb->n_bars; ++i) {
+            struct wb_bar *bar = &wb->bars[i];
+            set_status(bar, bar->status, strlen(bar->status));
+            schedule_bar(bar);
+        }
+    }
+    if (bg) {
+        wayland_set_background(wb->wl, config->bg_color);
+    }
+    // new fonts may reuse the addresses in the layouts and the background
+    // is not part of them at all
+    if (fonts || bg) {
+        wayland_invalidate(wb->wl);
+    }
 
-    // append
-    strcat(*cstr_ptr, attr);
+    for (size_t i = 0; i < wb->n_bars; ++i) {
+        const struct wb_bar_config *b = &config->bars[i];
+        if (old.bars[i].height != b->height ||
+            old.bars[i].bottom != b->bottom) {
+            wayland_set_geometry(wb->wl, i, b->height, b->height,
+                                 layer_anchor(b));
+        }
+    }
 }
 
-// takes a fontconfig font pattern and scales the size and pixelsize
-// attributes according to the scale paramter
-// * returns a heap allocated string
-static char *scale_font_pattern(const char *pattern, int32_t scale) {
-    FcPattern *pat = FcNameParse((const FcChar8 *)pattern);
-    double pt_size = -1.0;
-    FcResult have_pt_size = FcPatternGetDouble(pat, FC_SIZE, 0, &pt_size);
-
-    double px_size = -1.0;
-    FcResult have_px_size = FcPatternGetDouble(pat, FC_PIXEL_SIZE, 0, &px_size);
-
-    FcPatternRemove(pat, FC_SIZE, 0);
-    FcPatternRemove(pat, FC_PIXEL_SIZE, 0);
-
-    char *stripped = (char *)FcNameUnparse(pat);
-    if (have_pt_size == FcResultMatch) {
-        strappf(&stripped, ":size=%.2f", pt_size * scale);
+// Handles the input and the module timer of a bar, returns false once the
+// bar has neither of them left.
+static bool dispatch_bar(struct wb_bar *bar, struct pollfd *input,
+                         struct pollfd *timer) {
+    // a hangup is read too, it delivers a last line without a newline
+    bool failed = false;
+    if (input->revents & (POLLIN | POLLHUP)) {
+        uint64_t start = stats_now();
+        if (line_buffer_read(&bar->input, bar->input_fd) < 0) {
+            log_error("error while reading in status");
+            failed = true;
+        }
+        stats_record(STATS_READ, start);
+
+        // everything read in this wakeup collapses into the newest line,
+        // monitors pick it up on their next frame
+        size_t len;
+        const char *line = line_buffer_last_line(&bar->input, &len);
+        if (line && bar->modules) {
+            modules_set_stdin(bar->modules, line, len);
+            update_modules(bar);
+        } else if (line) {
+            update_status(bar, line, len);
+        }
     }
-    if (have_px_size == FcResultMatch) {
-        strappf(&stripped, ":pixelsize=%.2f", px_size * scale);
+    // after a hangup the pipe is drained over as many wakeups as it takes,
+    // a read stops at READ_MAX. The last status stays up.
+    if (input->fd >= 0 &&
+        (bar->input.eof || failed || input->revents & (POLLERR | POLLNVAL))) {
+        input->fd = -1;
     }
 
-    FcPatternDestroy(pat);
+    // module updates
+    if (timer->revents & POLLIN) {
+        modules_tick(bar->modules);
+        update_modules(bar);
+    }
 
-    return stripped;
+    // modules keep the bar alive without an input
+    return input->fd >= 0 || bar->modules;
 }
 
-static void event_loop(struct wb *bar) {
-    enum { POLL_WL, POLL_STDIN };
-    struct pollfd fds[] = {
-        [POLL_WL] = {.fd = bar->wl->fd, .events = POLLIN},
-        [POLL_STDIN] = {.fd = STDIN_FILENO, .events = POLLIN},
+static void event_loop(struct wb *wb) {
+    enum { POLL_WL, POLL_SIGNAL, POLL_STATS, POLL_CONFIG, POLL_BARS };
+    // every bar polls its input and its module timer, then the listening
+    // socket and the connected clients come last
+    struct pollfd fds[POLL_BARS + 2 * WB_MAX_BARS + 1 + IPC_MAX_CLIENTS] = {
+        [POLL_WL] = {.fd = wb->wl->fd, .events = POLLIN},
+        [POLL_SIGNAL] = {.fd = wb->signal_fd, .events = POLLIN},
+        [POLL_STATS] = {.fd = wb->stats_fd, .events = POLLIN},
+        [POLL_CONFIG] = {.fd = wb->config_fd, .events = POLLIN},
     };
+    for (size_t i = 0; i < wb->n_bars; ++i) {
+        struct wb_bar *bar = &wb->bars[i];
+        // poll ignores negative fds
+        fds[POLL_BARS + 2 * i] =
+            (struct pollfd){.fd = bar->input_fd, .events = POLLIN};
+        fds[POLL_BARS + 2 * i + 1] = (struct pollfd){
+            .fd = bar->modules ? bar->modules->timer_fd : -1,
+            .events = POLLIN};
+    }
+    const size_t poll_ipc = POLL_BARS + 2 * wb->n_bars;
+    struct modules *mods[WB_MAX_BARS];
+    size_t n_mods = 0;
+    for (size_t i = 0; i < wb->n_bars; ++i) {
+        if (wb->bars[i].modules) {
+            mods[n_mods++] = wb->bars[i].modules;
+        }
+    }
+
     while (true) {
         int ret;
         do {
-            ret = wl_display_dispatch_pending(bar->wl->display);
-            wl_display_flush(bar->wl->display);
+            ret = wl_display_dispatch_pending(wb->wl->display);
+            // everything that changed since the last wakeup is drawn at once
+            wayland_render(wb->wl);
+            wl_display_flush(wb->wl->display);
         } while (ret == -1);
 
-        ret = poll(fds, sizeof(fds) / sizeof(fds[0]), -1);
+        // what was logged since the last wakeup is written in one go
+        log_flush();
+
+        nfds_t nfds = poll_ipc;
+        if (wb->ipc) {
+            nfds += ipc_poll_fds(wb->ipc, &fds[poll_ipc]);
+        }
+
+        ret = poll(fds, nfds, -1);
         if (ret < 0) {
             log_fatal("poll failed");
         }
 
+        // stats on demand or periodically
+        if (fds[POLL_SIGNAL].revents & POLLIN) {
+            struct signalfd_siginfo info;
+            if (read(wb->signal_fd, &info, sizeof(info)) == sizeof(info)) {
+                stats_dump();
+            }
+        }
+        if (fds[POLL_STATS].revents & POLLIN) {
+            uint64_t expirations;
+            if (read(wb->stats_fd, &expirations, sizeof(expirations)) > 0) {
+                stats_dump();
+            }
+        }
+
+        if (fds[POLL_CONFIG].revents & POLLIN &&
+            config_changed(wb->config_fd, wb->config.config_path)) {
+            reload_config(wb);
+        }
+
         // wayland events
         if (fds[POLL_WL].revents & POLLIN) {
-            wl_display_dispatch(bar->wl->display);
+            wl_display_dispatch(wb->wl->display);
         }
         if (fds[POLL_WL].revents & POLLHUP) {
             break; // if wayland disconnects then exit event loop
         }
 
-        // stdin events
-        if (fds[POLL_STDIN].revents & POLLIN) {
-            if (!fgets(bar->status, sizeof(bar->status), stdin)) {
-                log_error("error while reading in status");
-                continue;
-            }
-            bar->status[strcspn(bar->status, "\n")] = '\0';
-
-            struct wayland_monitor *mon;
-            wl_list_for_each(mon, &bar->wl->monitors, link) {
-                render(mon, draw_bar, bar);
-            }
+        // status updates, the process ends once no bar can change anymore
+        bool alive = false;
+        for (size_t i = 0; i < wb->n_bars; ++i) {
+            alive |= dispatch_bar(&wb->bars[i], &fds[POLL_BARS + 2 * i],
+                                  &fds[POLL_BARS + 2 * i + 1]);
         }
-        if (fds[POLL_STDIN].revents & POLLHUP) {
+        if (!alive) {
             break;
         }
+
+        // segment updates from clients, unchanged segments keep their damage
+        // regions and are not redrawn
+        if (wb->ipc && ipc_dispatch(wb->ipc, &fds[poll_ipc], mods, n_mods)) {
+            for (size_t i = 0; i < wb->n_bars; ++i) {
+                if (wb->bars[i].modules) {
+                    update_modules(&wb->bars[i]);
+                }
+            }
+        }
     }
 }
 
-static void on_scale(void *data, struct wayland_monitor *mon, int32_t scale) {
-    struct wb *bar = data;
+static void on_scale(void *data, struct wayland_monitor *mon,
+                     uint32_t scale) {
+    struct wb_bar *bar = data;
+    struct wb *wb = bar->wb;
 
-    // destroy previous font
-    fcft_destroy(bar->font);
+    // monitors with the same scale share a font, across bars as well
+    wait_prefetch(wb);
+    if (!font_for_scale(wb, scale)) {
+        load_font(wb, scale);
+    }
 
-    // load new font
-    const char *fonts[] = {scale_font_pattern(bar->config.font, scale)};
-    bar->font = fcft_from_name(sizeof(fonts) / sizeof(fonts[0]), fonts, NULL);
-    free((char *)fonts[0]);
-    if (!bar->font) {
-        log_fatal("failed to load font '%s'", bar->config.font);
+    // unload fonts of scales no monitor uses anymore
+    struct scaled_font *sf, *tmp;
+    wl_list_for_each_safe(sf, tmp, &wb->fonts, link) {
+        bool used = false;
+        struct wayland_monitor *m;
+        wl_list_for_each(m, &mon->wl->monitors, link) {
+            used |= m->scale && monitor_scale(m) == sf->scale;
+        }
+        if (!used) {
+            unload_font(wb, sf);
+        }
     }
-    log_info("loaded font: %s", bar->font->name);
 
     // render with new font
-    render(mon, draw_bar, bar);
+    schedule_render(mon);
+}
+
+// A FIFO is held open for writing as well, so its readers never see the end
+// of file and producers can come and go.
+static int open_input(const char *path) {
+    struct stat st;
+    int mode = stat(path, &st) == 0 && S_ISFIFO(st.st_mode) ? O_RDWR
+                                                             : O_RDONLY;
+    int fd = open(path, mode | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) {
+        log_fatal("failed to open input %s", path);
+    }
+    return fd;
+}
+
+static void bar_init(struct wb *wb, struct wb_bar *bar,
+                     const struct wb_bar_config *config, size_t index) {
+    bar->wb = wb;
+    bar->status = calloc(1, wb->config.max_status + 1);
+    bar->text = malloc(wb->config.max_status);
+    bar->input.max_line = wb->config.max_status;
+
+    // only the first bar reads stdin unless it is given an input
+    bar->input_fd = -1;
+    if (config->input) {
+        bar->input_fd = open_input(config->input);
+    } else if (index == 0) {
+        // a partial line must never block wayland dispatch
+        int flags = fcntl(STDIN_FILENO, F_GETFL);
+        if (flags == -1 ||
+            fcntl(STDIN_FILENO, F_SETFL, flags | O_NONBLOCK) == -1) {
+            log_fatal("failed to make stdin non-blocking");
+        }
+        bar->input_fd = STDIN_FILENO;
+    } else if (!config->format) {
+        log_fatal("bar %zu needs an input or a format", index + 1);
+    }
+
+    if (config->format) {
+        bar->modules = modules_create(config->format, wb->config.interval);
+        modules_expand(bar->modules);
+        set_status(bar, bar->modules->line, bar->modules->line_len);
+    }
+}
+
+static void bar_finish(struct wb_bar *bar) {
+    if (bar->input_fd > STDIN_FILENO) {
+        close(bar->input_fd);
+    }
+    line_buffer_finish(&bar->input);
+    if (bar->modules) {
+        modules_destroy(bar->modules);
+    }
+    free(bar->status);
+    free(bar->text);
 }
 
 void wb_run(struct wb_config config) {
     fcft_init(FCFT_LOG_COLORIZE_AUTO, false, FCFT_LOG_CLASS_NONE);
 
-    struct wb *bar = calloc(1, sizeof(*bar));
-    bar->config = config;
+    // without a format the segments are named after their position
+    if (config.socket && !config.bars[0].format) {
+        config.bars[0].format = "%{ipc:left}%|%{ipc:center}%|%{ipc:right}";
+    }
+
+    // a small pool is enough, there are rarely more monitors than that
+    if (!config.workers) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        config.workers = cpus < 1 ? 1 : cpus < 4 ? cpus : 4;
+    }
+
+    struct wb *wb = calloc(1, sizeof(*wb));
+    wb->base = config;
+    wb->config_fd = -1;
+    if (config.config_path) {
+        config_load(&config, config.config_path);
+        wb->config_fd = config_watch(config.config_path);
+        if (config.n_fonts == 0) {
+            memcpy(config.fonts, wb->base.fonts, sizeof(config.fonts));
+            config.n_fonts = wb->base.n_fonts;
+        }
+    }
+    wb->config = config;
+    log_set_level(config.log_level);
+    wl_list_init(&wb->fonts);
+    // all bars share the fonts and the caches of the workers
+    draw_workers_init(wb, config.workers);
+
+    if (config.socket) {
+        wb->ipc = ipc_create();
+    }
+    wb->n_bars = config.n_bars;
+    for (size_t i = 0; i < wb->n_bars; ++i) {
+        bar_init(wb, &wb->bars[i], &config.bars[i], i);
+    }
+
+    // SIGUSR1 is read from the event loop instead of interrupting it
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGUSR1);
+    if (sigprocmask(SIG_BLOCK, &mask, NULL) < 0 ||
+        (wb->signal_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC)) <
+            0) {
+        log_fatal("failed to create signalfd");
+    }
+    wb->stats_fd = -1;
+    if (config.stats) {
+        wb->stats_fd =
+            timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        struct itimerspec its = {
+            .it_interval = {config.stats, 0},
+            .it_value = {config.stats, 0},
+        };
+        if (wb->stats_fd < 0 ||
+            timerfd_settime(wb->stats_fd, 0, &its, NULL) < 0) {
+            log_fatal("failed to create stats timer");
+        }
+    }
+
+    // most outputs are not scaled, their fonts are ready by the time the
+    // first one shows up. Started after SIGUSR1 is blocked, threads inherit
+    // the mask.
+    prefetch_font(wb, SCALE_BASE);
+    stats_trace("fonts requested");
+
     struct wayland_layer_surface_config ls_config = {
         .layer = ZWLR_LAYER_SHELL_V1_LAYER_TOP,
-        .height = config.height,
-        .zone = config.height,
-        .anchor = (config.bottom ? ZWLR_LAYER_SURFACE_V1_ANCHOR_BOTTOM
-                                 : ZWLR_LAYER_SURFACE_V1_ANCHOR_TOP) |
-                  ZWLR_LAYER_SURFACE_V1_ANCHOR_LEFT |
-                  ZWLR_LAYER_SURFACE_V1_ANCHOR_RIGHT};
-    bar->wl = wayland_create(ls_config, on_scale, bar);
+        .background = config.bg_color,
+        .frame_cache = config.frame_cache,
+        .frame_cache_bytes = (size_t)config.frame_cache_size << 20,
+        .workers = config.workers,
+        .compact = config.rgb565};
+    struct wayland_bar bars[WB_MAX_BARS];
+    for (size_t i = 0; i < wb->n_bars; ++i) {
+        const struct wb_bar_config *b = &config.bars[i];
+        bars[i] = (struct wayland_bar){
+            .height = b->height,
+            .zone = b->height,
+            .anchor = layer_anchor(b),
+            .data = &wb->bars[i],
+        };
+    }
+    // one connection for all bars
+    wb->wl = wayland_create(ls_config, bars, wb->n_bars, on_scale, layout_bar,
+                            draw_bar);
 
     // the main event loop which handles input and wayland events
-    event_loop(bar);
+    event_loop(wb);
 
     // cleanup
-    wayland_destroy(bar->wl);
-    fcft_destroy(bar->font);
+    wayland_destroy(wb->wl);
+    wait_prefetch(wb);
+    struct scaled_font *sf, *tmp;
+    wl_list_for_each_safe(sf, tmp, &wb->fonts, link) {
+        unload_font(wb, sf);
+    }
+    draw_workers_finish(wb);
     fcft_fini();
-    free(bar);
+    for (size_t i = 0; i < wb->n_bars; ++i) {
+        bar_finish(&wb->bars[i]);
+    }
+    if (wb->ipc) {
+        ipc_destroy(wb->ipc);
+    }
+    close(wb->signal_fd);
+    if (wb->stats_fd >= 0) {
+        close(wb->stats_fd);
+    }
+    if (wb->config_fd >= 0) {
+        close(wb->config_fd);
+    }
+    free(wb);
+    log_flush();
 }
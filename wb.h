@@ -1,25 +1,130 @@
 #ifndef WB_H
 #define WB_H
 
+#include <pixman.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdint.h>
 
+#include "ipc.h"
+#include "line-buffer.h"
+#include "modules.h"
+#include "text-cache.h"
 #include "wayland.h"
 
-struct wb_config {
-    char font[128];
+// separates the left, center and right parts of a status line
+#define ALIGNMENT_SEP '\x1f'
+
+#define WB_MAX_FONTS 4
+// spans of a status line beyond this are dropped
+#define WB_MAX_SPANS 32
+#define WB_MAX_BARS 4
+
+struct wb_bar_config {
     bool bottom;
     uint32_t height;
+    const char *format; // status built from modules instead of the input
+    const char *input;  // file or FIFO of status lines, NULL for stdin
+};
+
+struct wb_config {
+    char fonts[WB_MAX_FONTS][128]; // selected with ^fn(N), the first is used
+                                   // by default
+    size_t n_fonts;
+    struct wb_bar_config bars[WB_MAX_BARS];
+    size_t n_bars;
+    uint32_t max_status; // status lines are truncated to this many bytes
+    uint32_t text_cache; // number of shaped text runs kept around
     uint32_t bg_color, fg_color; // ARGB
+    uint32_t interval;  // milliseconds between module updates
+    bool socket;        // accept %{ipc:name} updates on a socket
+    uint32_t stats;     // seconds between stats dumps, 0 disables them
+    uint32_t frame_cache;      // buffers per surface
+    uint32_t frame_cache_size; // MiB the buffers of a surface may take up
+    uint32_t workers;          // threads drawing monitors in parallel
+    bool rgb565;               // 16 bit buffers if the background is opaque
+    const char *config_path;   // watched and applied on top, NULL for none
+    int log_level;             // messages below it are discarded
+};
+
+// a piece of the status drawn with the same attributes, the text points
+// into the text of the bar and is not null terminated
+struct span {
+    const char *text;
+    size_t len;
+    uint32_t fg, bg; // ARGB
+    uint8_t font;    // index into the configured fonts
+};
+
+// a left, center or right part of the status
+struct segment {
+    struct span *spans;
+    size_t count;
+};
+
+// a shaped span and where it is drawn
+struct text {
+    struct fcft_font *font;
+    const struct fcft_text_run *run;
+    int32_t x, y;   // pen position of the first glyph
+    int32_t width;  // advance of the whole run
+    int32_t x1, x2; // horizontal ink extents
+};
+
+// Scratch state of a thread drawing monitors. A monitor is laid out and drawn
+// by the same worker, so its texts stay valid in between.
+struct wb_worker {
+    struct text texts[WB_MAX_SPANS]; // spans laid out for the current frame
+    struct text_cache text_cache;
+    uint32_t *utf32; // scratch space for decoding text before shaping
+    size_t utf32_len;
+    pixman_glyph_cache_t *glyph_cache; // mono glyphs, reset with the fonts
+    pixman_glyph_t *glyphs;            // scratch space for batching a run
+    size_t glyphs_len;
+};
+
+// the fonts loaded for the scale of one or more monitors
+struct scaled_font {
+    uint32_t scale; // in units of 1/SCALE_BASE
+    struct fcft_font *fonts[WB_MAX_FONTS];
+    size_t count;
+    struct wl_list link;
+};
+
+// A bar with a status of its own, shown on every output.
+struct wb_bar {
+    struct wb *wb;
+    struct segment segments[3]; // left, center and right part of status
+    struct span spans[WB_MAX_SPANS];
+    size_t n_spans;
+    int input_fd; // stdin, an opened file or -1 without an input
+    struct line_buffer input;
+    struct modules *modules; // NULL without a format
+    char *status;            // max_status + 1 bytes
+    char *text;              // the status without markup, max_status bytes
 };
 
 struct wb {
     struct wayland *wl;
     struct wb_config config;
+    struct wb_config base; // from the command line, the file is applied on top
+    int config_fd;         // inotify watch of the config file or -1
     bool exit;
 
-    struct fcft_font *font;
-    char status[1024];
+    // shared by all workers, only changed while none of them is drawing
+    struct wl_list fonts; // scaled_font::link
+    // fonts being loaded in the background, see prefetch_font()
+    pthread_t prefetch_thread;
+    struct scaled_font *prefetched;
+    uint32_t prefetch_scale;
+    bool prefetching;
+    struct wb_worker *workers;
+    size_t n_workers;
+    struct wb_bar bars[WB_MAX_BARS];
+    size_t n_bars;
+    struct ipc *ipc; // NULL without a socket, updates the modules of all bars
+    int signal_fd;   // SIGUSR1 dumps the stats
+    int stats_fd;    // timer for periodic stats dumps or -1
 };
 
 void wb_run(struct wb_config config);
@@ -0,0 +1,135 @@
+#include "worker-pool.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "log.h"
+
+struct worker {
+    struct worker_pool *pool;
+    unsigned index;
+    pthread_t thread;
+};
+
+struct worker_pool {
+    struct worker *workers; // count - 1 threads, worker 0 is the caller
+    unsigned count;
+
+    pthread_mutex_t lock;
+    pthread_cond_t start, done;
+    uint64_t generation; // bumped for every run
+    unsigned n;          // workers taking part in the current run
+    unsigned pending;    // threads of the current run still busy
+    worker_fn fn;
+    void *data;
+    bool exit;
+};
+
+static void *worker_main(void *arg) {
+    struct worker *w = arg;
+    struct worker_pool *pool = w->pool;
+    uint64_t seen = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    while (true) {
+        while (pool->generation == seen && !pool->exit) {
+            pthread_cond_wait(&pool->start, &pool->lock);
+        }
+        if (pool->exit) {
+            break;
+        }
+        seen = pool->generation;
+        if (w->index >= pool->n) {
+            continue;
+        }
+
+        worker_fn fn = pool->fn;
+        void *data = pool->data;
+        pthread_mutex_unlock(&pool->lock);
+        fn(data, w->index);
+        pthread_mutex_lock(&pool->lock);
+
+        if (--pool->pending == 0) {
+            pthread_cond_signal(&pool->done);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+struct worker_pool *worker_pool_create(unsigned count) {
+    assert(count > 0);
+    struct worker_pool *pool = calloc(1, sizeof(*pool));
+    pool->count = count;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->start, NULL);
+    pthread_cond_init(&pool->done, NULL);
+
+    // signals are left to the event loop
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    pool->workers = calloc(count, sizeof(*pool->workers));
+    for (unsigned i = 1; i < count; ++i) {
+        struct worker *w = &pool->workers[i];
+        w->pool = pool;
+        w->index = i;
+        if (pthread_create(&w->thread, NULL, worker_main, w) != 0) {
+            log_fatal("failed to start worker thread");
+        }
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+    return pool;
+}
+
+void worker_pool_destroy(struct worker_pool *pool) {
+    pthread_mutex_lock(&pool->lock);
+    pool->exit = true;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+    for (unsigned i = 1; i < pool->count; ++i) {
+        pthread_join(pool->workers[i].thread, NULL);
+    }
+
+    pthread_cond_destroy(&pool->done);
+    pthread_cond_destroy(&pool->start);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->workers);
+    free(pool);
+}
+
+unsigned worker_pool_count(const struct worker_pool *pool) {
+    return pool->count;
+}
+
+void worker_pool_run(struct worker_pool *pool, unsigned n, worker_fn fn,
+                     void *data) {
+    assert(n <= pool->count);
+    if (n > 1) {
+        pthread_mutex_lock(&pool->lock);
+        pool->fn = fn;
+        pool->data = data;
+        pool->n = n;
+        pool->pending = n - 1;
+        ++pool->generation;
+        pthread_cond_broadcast(&pool->start);
+        pthread_mutex_unlock(&pool->lock);
+    }
+
+    if (n > 0) {
+        fn(data, 0);
+    }
+
+    if (n > 1) {
+        pthread_mutex_lock(&pool->lock);
+        while (pool->pending > 0) {
+            pthread_cond_wait(&pool->done, &pool->lock);
+        }
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
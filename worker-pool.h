@@ -0,0 +1,21 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+// Runs the same function on a fixed set of threads and waits for all of them.
+// The calling thread takes part as worker 0, so a pool of one never starts a
+// thread.
+typedef void (*worker_fn)(void *data, unsigned worker);
+
+struct worker_pool;
+
+struct worker_pool *worker_pool_create(unsigned count);
+void worker_pool_destroy(struct worker_pool *pool);
+
+unsigned worker_pool_count(const struct worker_pool *pool);
+
+// Calls fn(data, i) for every i below n on worker i and returns once all of
+// them returned. n must not exceed the size of the pool.
+void worker_pool_run(struct worker_pool *pool, unsigned n, worker_fn fn,
+                     void *data);
+
+#endif